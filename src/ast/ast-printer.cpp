@@ -11,7 +11,7 @@ using namespace delta;
 
 namespace {
 
-int indentLevel = 0;
+thread_local int indentLevel = 0;
 
 /// Inserts a line break followed by appropriate indentation.
 std::ostream& br(std::ostream& out) {
@@ -298,8 +298,44 @@ std::ostream& operator<<(std::ostream& out, const Decl& decl) {
     llvm_unreachable("all cases handled");
 }
 
+void printInterface(std::ostream& out, const Decl& decl) {
+    if (auto* functionDecl = llvm::dyn_cast<FunctionLikeDecl>(&decl)) {
+        auto* typeDecl = functionDecl->getTypeDecl();
+        if (functionDecl->isGeneric() || (typeDecl && typeDecl->isGeneric())) {
+            out << decl; // Generic functions are instantiated by the units that use them.
+            return;
+        }
+
+        out << br << "(function-interface " << (typeDecl ? typeDecl->getName().str() + "." : "")
+            << functionDecl->getName().str() << " (";
+        for (const ParamDecl& param : functionDecl->getParams()) {
+            out << param;
+        }
+        out << ") " << functionDecl->getReturnType();
+        if (functionDecl->isMutating()) out << " mutating";
+        if (functionDecl->isExtern()) out << " extern";
+        out << ")";
+    } else if (auto* typeDecl = llvm::dyn_cast<TypeDecl>(&decl)) {
+        out << *typeDecl;
+        for (const GenericParamDecl& genericParam : typeDecl->getGenericParams()) {
+            out << " " << genericParam.getName().str();
+        }
+        for (auto& memberDecl : typeDecl->getMemberDecls()) {
+            printInterface(out, *memberDecl);
+        }
+    } else {
+        out << decl;
+    }
+}
+
 } // anonymous namespace
 
+void delta::printInterface(std::ostream& out, const SourceFile& sourceFile) {
+    for (const auto& decl : sourceFile.getTopLevelDecls()) {
+        ::printInterface(out, *decl);
+    }
+}
+
 std::ostream& delta::operator<<(std::ostream& out, const Module& module) {
     for (const auto& sourceFile : module.getSourceFiles()) {
         out << "(source-file " << sourceFile.getFilePath();
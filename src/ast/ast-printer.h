@@ -5,7 +5,11 @@
 namespace delta {
 
 class Module;
+class SourceFile;
 
 std::ostream& operator<<(std::ostream& out, const Module& module);
+/// Prints the parts of the file's declarations that other files depend on, i.e. everything except the
+/// bodies of non-generic functions. Used to detect which compilation units need to be rebuilt.
+void printInterface(std::ostream& out, const SourceFile& sourceFile);
 
 }
@@ -0,0 +1,75 @@
+#include <llvm/ADT/STLExtras.h>
+#include <llvm/ADT/StringRef.h>
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <clang/Basic/VirtualFileSystem.h>
+#include "compiler-instance.h"
+#include "decl.h"
+#include "module.h"
+#include "type.h"
+#include "../support/utility.h"
+
+using namespace delta;
+
+namespace {
+
+thread_local CompilerInstance* currentInstance = nullptr;
+
+template<typename T>
+size_t getCacheSize(const std::vector<std::unique_ptr<T>>& cache) {
+    return cache.capacity() * sizeof(std::unique_ptr<T>) + cache.size() * sizeof(T);
+}
+
+} // anonymous namespace
+
+size_t TypeTable::getMemoryUsage() const {
+    return getCacheSize(basicTypes) + getCacheSize(arrayTypes) + getCacheSize(tupleTypes)
+           + getCacheSize(functionTypes) + getCacheSize(pointerTypes);
+}
+
+CompilerInstance::CompilerInstance(llvm::IntrusiveRefCntPtr<clang::vfs::FileSystem> fileSystem)
+: importedBodiesOnDemand(false), llvmContext(llvm::make_unique<llvm::LLVMContext>()),
+  fileSystem(fileSystem ? std::move(fileSystem) : clang::vfs::getRealFileSystem()),
+  previousInstance(currentInstance) {
+    currentInstance = this;
+}
+
+CompilerInstance::~CompilerInstance() {
+    ASSERT(currentInstance == this, "compiler instances must be destroyed in reverse order of construction");
+    currentInstance = previousInstance;
+}
+
+CompilerInstance& CompilerInstance::getCurrent() {
+    ASSERT(currentInstance, "no compiler instance on the current thread");
+    return *currentInstance;
+}
+
+std::vector<Module*> CompilerInstance::getImportedModules() const {
+    return map(importedModules,
+               [](const std::pair<std::string, std::shared_ptr<Module>>& p) { return p.second.get(); });
+}
+
+std::shared_ptr<Module> CompilerInstance::getImportedModule(llvm::StringRef name) const {
+    auto it = importedModules.find(name);
+    if (it == importedModules.end()) return nullptr;
+    return it->second;
+}
+
+void CompilerInstance::addImportedModule(std::shared_ptr<Module> module) {
+    std::string name = module->getName();
+    importedModules[std::move(name)] = std::move(module);
+}
+
+void CompilerInstance::addModuleInterfaceDirectory(std::string directoryPath) {
+    moduleInterfaceDirectories.push_back(std::move(directoryPath));
+}
+
+Decl& CompilerInstance::addNonASTDecl(std::unique_ptr<Decl> decl) {
+    nonASTDecls.push_back(std::move(decl));
+    return *nonASTDecls.back();
+}
+
+const llvm::MemoryBuffer& CompilerInstance::addFileBuffer(std::unique_ptr<llvm::MemoryBuffer> buffer) {
+    fileBuffers.push_back(std::move(buffer));
+    return *fileBuffers.back();
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <llvm/ADT/ArrayRef.h>
+#include <llvm/ADT/IntrusiveRefCntPtr.h>
+
+namespace clang {
+namespace vfs {
+class FileSystem;
+}
+}
+
+namespace llvm {
+class LLVMContext;
+class MemoryBuffer;
+class StringRef;
+}
+
+namespace delta {
+
+class ArrayType;
+class BasicType;
+class Decl;
+class FunctionType;
+class Module;
+class PointerType;
+class TupleType;
+
+/// Storage for the uniqued instances of each kind of type, so that types can be compared by identity.
+struct TypeTable {
+    std::vector<std::unique_ptr<BasicType>> basicTypes;
+    std::vector<std::unique_ptr<ArrayType>> arrayTypes;
+    std::vector<std::unique_ptr<TupleType>> tupleTypes;
+    std::vector<std::unique_ptr<FunctionType>> functionTypes;
+    std::vector<std::unique_ptr<PointerType>> pointerTypes;
+
+    /// Returns the approximate number of bytes used by the interned types, excluding the memory owned
+    /// by the types, such as the generic argument lists of BasicTypes.
+    size_t getMemoryUsage() const;
+};
+
+/// The state of a single compilation: the imported modules, the declarations and types created during
+/// the compilation, the source file buffers, the LLVM context, and the file system from which imported
+/// modules and C headers are read. Independent compilations each use their own instance, which allows
+/// running them concurrently on different threads.
+///
+/// Constructing an instance makes it the current one on the calling thread until it's destroyed. The
+/// type factory functions such as BasicType::get() create types in the current instance, as types are
+/// created deep inside AST methods that have no other access to the compilation state.
+class CompilerInstance {
+public:
+    /// Uses the real file system if `fileSystem` is null.
+    explicit CompilerInstance(llvm::IntrusiveRefCntPtr<clang::vfs::FileSystem> fileSystem = nullptr);
+    ~CompilerInstance();
+    CompilerInstance(const CompilerInstance&) = delete;
+    CompilerInstance& operator=(const CompilerInstance&) = delete;
+
+    /// Returns the instance that was most recently constructed on the calling thread and still exists.
+    static CompilerInstance& getCurrent();
+
+    std::vector<Module*> getImportedModules() const;
+    /// Returns the imported module with the given name, or null if it hasn't been imported yet.
+    std::shared_ptr<Module> getImportedModule(llvm::StringRef name) const;
+    void addImportedModule(std::shared_ptr<Module> module);
+    /// Returns the directories that are searched for prebuilt module interfaces, which are used in place of
+    /// the sources of imported modules. Each directory contains the interfaces in subdirectories named after
+    /// the modules.
+    llvm::ArrayRef<std::string> getModuleInterfaceDirectories() const { return moduleInterfaceDirectories; }
+    void addModuleInterfaceDirectory(std::string directoryPath);
+    /// Returns true if the function bodies of imported modules are type-checked only once type-checked code
+    /// references them, instead of all of them up front. Off by default.
+    bool typechecksImportedBodiesOnDemand() const { return importedBodiesOnDemand; }
+    void setTypecheckImportedBodiesOnDemand(bool onDemand) { importedBodiesOnDemand = onDemand; }
+    /// Takes ownership of a declaration that is not in any AST but is referenced by a symbol table.
+    Decl& addNonASTDecl(std::unique_ptr<Decl> decl);
+    /// Takes ownership of a source file buffer, which the tokens and source locations point into.
+    const llvm::MemoryBuffer& addFileBuffer(std::unique_ptr<llvm::MemoryBuffer> buffer);
+    TypeTable& getTypeTable() { return typeTable; }
+    llvm::LLVMContext& getLLVMContext() { return *llvmContext; }
+    clang::vfs::FileSystem& getFileSystem() const { return *fileSystem; }
+    llvm::IntrusiveRefCntPtr<clang::vfs::FileSystem> getFileSystemPtr() const { return fileSystem; }
+
+private:
+    std::unordered_map<std::string, std::shared_ptr<Module>> importedModules;
+    std::vector<std::string> moduleInterfaceDirectories;
+    bool importedBodiesOnDemand;
+    std::vector<std::unique_ptr<Decl>> nonASTDecls;
+    std::vector<std::unique_ptr<llvm::MemoryBuffer>> fileBuffers;
+    TypeTable typeTable;
+    std::unique_ptr<llvm::LLVMContext> llvmContext;
+    llvm::IntrusiveRefCntPtr<clang::vfs::FileSystem> fileSystem;
+    CompilerInstance* previousInstance;
+};
+
+}
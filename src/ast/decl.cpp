@@ -1,10 +1,39 @@
+#include <llvm/ADT/Statistic.h>
 #include <llvm/ADT/StringRef.h>
 #include <llvm/Support/ErrorHandling.h>
 #include "decl.h"
 #include "../support/utility.h"
 
+#define DEBUG_TYPE "ast"
+
+STATISTIC(NumParamDecls, "Number of ParamDecl nodes created");
+STATISTIC(NumGenericParamDecls, "Number of GenericParamDecl nodes created");
+STATISTIC(NumFunctionDecls, "Number of FunctionDecl nodes created");
+STATISTIC(NumMethodDecls, "Number of MethodDecl nodes created");
+STATISTIC(NumInitDecls, "Number of InitDecl nodes created");
+STATISTIC(NumDeinitDecls, "Number of DeinitDecl nodes created");
+STATISTIC(NumTypeDecls, "Number of TypeDecl nodes created");
+STATISTIC(NumVarDecls, "Number of VarDecl nodes created");
+STATISTIC(NumFieldDecls, "Number of FieldDecl nodes created");
+STATISTIC(NumImportDecls, "Number of ImportDecl nodes created");
+
 using namespace delta;
 
+Decl::Decl(DeclKind kind) : kind(kind) {
+    switch (kind) {
+        case DeclKind::ParamDecl:        ++NumParamDecls; break;
+        case DeclKind::GenericParamDecl: ++NumGenericParamDecls; break;
+        case DeclKind::FunctionDecl:     ++NumFunctionDecls; break;
+        case DeclKind::MethodDecl:       ++NumMethodDecls; break;
+        case DeclKind::InitDecl:         ++NumInitDecls; break;
+        case DeclKind::DeinitDecl:       ++NumDeinitDecls; break;
+        case DeclKind::TypeDecl:         ++NumTypeDecls; break;
+        case DeclKind::VarDecl:          ++NumVarDecls; break;
+        case DeclKind::FieldDecl:        ++NumFieldDecls; break;
+        case DeclKind::ImportDecl:       ++NumImportDecls; break;
+    }
+}
+
 Module* Decl::getModule() const {
     switch (getKind()) {
         case DeclKind::ParamDecl: return llvm::cast<ParamDecl>(this)->getParent()->getModule();
@@ -25,6 +54,10 @@ const FunctionType* FunctionLikeDecl::getFunctionType() const {
     return &llvm::cast<FunctionType>(*FunctionType::get(getReturnType(), std::move(paramTypes)));
 }
 
+bool FunctionLikeDecl::hasGenericBody() const {
+    return isGeneric() || (getTypeDecl() && getTypeDecl()->isGeneric());
+}
+
 bool FunctionDecl::signatureMatches(const FunctionDecl& other, bool matchReceiver) const {
     if (getName() != other.getName()) return false;
     if (matchReceiver && getTypeDecl() != other.getTypeDecl()) return false;
@@ -47,6 +80,11 @@ Type MethodDecl::getThisType() const {
     }
 }
 
+bool InitDecl::isStringLiteralInitializer() const {
+    return getTypeDecl()->getName() == "string" && getParams().size() == 1
+        && getParams()[0].getName() == "stringLiteral";
+}
+
 void TypeDecl::addField(FieldDecl&& field) {
     fields.emplace_back(std::move(field));
 }
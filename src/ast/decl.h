@@ -54,7 +54,7 @@ public:
     SourceLocation getLocation() const;
 
 protected:
-    Decl(DeclKind kind) : kind(kind) {}
+    Decl(DeclKind kind);
 
 private:
     const DeclKind kind;
@@ -126,9 +126,12 @@ private:
 
 class FunctionLikeDecl : public Decl {
 public:
-    bool isExtern() const { return !getBody(); }
+    bool isExtern() const { return !getBody() && !hasDeferredBody() && !bodyReleased; }
     bool isVariadic() const { return getProto().isVarArg(); }
     bool isGeneric() const { return !getProto().getGenericParams().empty(); }
+    /// Returns true if the body is compiled separately for each instantiation, i.e. if the function or its
+    /// receiver type is generic.
+    bool hasGenericBody() const;
     llvm::StringRef getName() const { return getProto().getName(); }
     Type getReturnType() const { return getProto().getReturnType(); }
     llvm::ArrayRef<ParamDecl> getParams() const { return getProto().getParams(); }
@@ -139,7 +142,29 @@ public:
     virtual TypeDecl* getTypeDecl() const { return nullptr; }
     virtual bool isMutating() const { return false; }
     std::vector<std::unique_ptr<Stmt>>* getBody() const { return body.get(); }
-    void setBody(std::shared_ptr<std::vector<std::unique_ptr<Stmt>>>&& body) { this->body = body; }
+    void setBody(std::shared_ptr<std::vector<std::unique_ptr<Stmt>>>&& body) {
+        this->body = body;
+        deferredBodyStart = nullptr;
+    }
+    /// Returns true if the body was skipped by parseSignatures() and hasn't been parsed yet.
+    bool hasDeferredBody() const { return deferredBodyStart != nullptr; }
+    /// Points to the '{' that starts the deferred body in the source buffer.
+    const char* getDeferredBodyStart() const { return deferredBodyStart; }
+    SourceLocation getDeferredBodyLocation() const { return deferredBodyLocation; }
+    void setDeferredBody(const char* start, SourceLocation location) {
+        deferredBodyStart = start;
+        deferredBodyLocation = location;
+    }
+    /// Frees the body once code has been generated for it, or marks a function parsed from a module interface
+    /// as having its body in the module's prebuilt library. The function remains a definition, not extern.
+    void releaseBody() {
+        body.reset();
+        bodyReleased = true;
+    }
+    /// Returns true if the body of this imported function is type-checked on demand and hasn't been referenced
+    /// by type-checked code yet. IRGen skips such functions, as nothing in the program calls them.
+    bool hasUncheckedBody() const { return uncheckedBody; }
+    void setUncheckedBody(bool unchecked) { uncheckedBody = unchecked; }
     SourceLocation getLocation() const { return location; }
     const FunctionType* getFunctionType() const;
     static bool classof(const Decl* d) { return d->isFunctionLikeDecl(); }
@@ -147,12 +172,18 @@ public:
 protected:
     FunctionLikeDecl(DeclKind kind, FunctionProto&& proto, SourceLocation location,
                      std::shared_ptr<std::vector<std::unique_ptr<Stmt>>>&& body = nullptr)
-    : Decl(kind), proto(std::move(proto)), body(std::move(body)), location(location) {}
+    : Decl(kind), proto(std::move(proto)), body(std::move(body)), location(location),
+      deferredBodyStart(nullptr), deferredBodyLocation(SourceLocation::invalid()), bodyReleased(false),
+      uncheckedBody(false) {}
 
 private:
     FunctionProto proto;
     std::shared_ptr<std::vector<std::unique_ptr<Stmt>>> body;
     SourceLocation location;
+    const char* deferredBodyStart;
+    SourceLocation deferredBodyLocation;
+    bool bodyReleased;
+    bool uncheckedBody;
 };
 
 class FunctionDecl : public FunctionLikeDecl {
@@ -196,6 +227,8 @@ public:
     : FunctionLikeDecl(DeclKind::InitDecl, FunctionProto("init", std::move(params), Type::getVoid(), {}, false),
                        location, std::move(body)), typeDecl(&receiverTypeDecl) {}
     TypeDecl* getTypeDecl() const override { return typeDecl; }
+    /// Returns true for 'string.init(stringLiteral:)', which IRGen calls implicitly for string literals.
+    bool isStringLiteralInitializer() const;
     static bool classof(const Decl* d) { return d->getKind() == DeclKind::InitDecl; }
 
 private:
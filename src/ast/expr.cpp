@@ -1,12 +1,49 @@
 #include "expr.h"
+#include <llvm/ADT/Statistic.h>
 #include <llvm/Support/ErrorHandling.h>
 #include "decl.h"
 #include "token.h"
 #include "mangle.h"
 #include "type-resolver.h"
 
+#define DEBUG_TYPE "ast"
+
+STATISTIC(NumVarExprs, "Number of VarExpr nodes created");
+STATISTIC(NumStringLiteralExprs, "Number of StringLiteralExpr nodes created");
+STATISTIC(NumIntLiteralExprs, "Number of IntLiteralExpr nodes created");
+STATISTIC(NumFloatLiteralExprs, "Number of FloatLiteralExpr nodes created");
+STATISTIC(NumBoolLiteralExprs, "Number of BoolLiteralExpr nodes created");
+STATISTIC(NumNullLiteralExprs, "Number of NullLiteralExpr nodes created");
+STATISTIC(NumArrayLiteralExprs, "Number of ArrayLiteralExpr nodes created");
+STATISTIC(NumPrefixExprs, "Number of PrefixExpr nodes created");
+STATISTIC(NumBinaryExprs, "Number of BinaryExpr nodes created");
+STATISTIC(NumCallExprs, "Number of CallExpr nodes created");
+STATISTIC(NumCastExprs, "Number of CastExpr nodes created");
+STATISTIC(NumMemberExprs, "Number of MemberExpr nodes created");
+STATISTIC(NumSubscriptExprs, "Number of SubscriptExpr nodes created");
+STATISTIC(NumUnwrapExprs, "Number of UnwrapExpr nodes created");
+
 using namespace delta;
 
+Expr::Expr(ExprKind kind, SourceLocation location) : kind(kind), type(nullptr), location(location) {
+    switch (kind) {
+        case ExprKind::VarExpr:           ++NumVarExprs; break;
+        case ExprKind::StringLiteralExpr: ++NumStringLiteralExprs; break;
+        case ExprKind::IntLiteralExpr:    ++NumIntLiteralExprs; break;
+        case ExprKind::FloatLiteralExpr:  ++NumFloatLiteralExprs; break;
+        case ExprKind::BoolLiteralExpr:   ++NumBoolLiteralExprs; break;
+        case ExprKind::NullLiteralExpr:   ++NumNullLiteralExprs; break;
+        case ExprKind::ArrayLiteralExpr:  ++NumArrayLiteralExprs; break;
+        case ExprKind::PrefixExpr:        ++NumPrefixExprs; break;
+        case ExprKind::BinaryExpr:        ++NumBinaryExprs; break;
+        case ExprKind::CallExpr:          ++NumCallExprs; break;
+        case ExprKind::CastExpr:          ++NumCastExprs; break;
+        case ExprKind::MemberExpr:        ++NumMemberExprs; break;
+        case ExprKind::SubscriptExpr:     ++NumSubscriptExprs; break;
+        case ExprKind::UnwrapExpr:        ++NumUnwrapExprs; break;
+    }
+}
+
 bool Expr::isLvalue() const {
     switch (getKind()) {
         case ExprKind::VarExpr: case ExprKind::StringLiteralExpr: case ExprKind::ArrayLiteralExpr:
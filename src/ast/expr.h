@@ -58,7 +58,7 @@ public:
     SourceLocation getLocation() const { return location; }
 
 protected:
-    Expr(ExprKind kind, SourceLocation location) : kind(kind), type(nullptr), location(location) {}
+    Expr(ExprKind kind, SourceLocation location);
 
 private:
     const ExprKind kind;
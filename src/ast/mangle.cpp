@@ -1,4 +1,13 @@
+#include <algorithm>
+#include <cctype>
+#include <utility>
+#include <vector>
 #include <llvm/ADT/ArrayRef.h>
+#include <llvm/ADT/SmallString.h>
+#include <llvm/ADT/StringMap.h>
+#include <llvm/ADT/StringRef.h>
+#include <llvm/Support/ErrorHandling.h>
+#include <llvm/Support/MD5.h>
 #include "mangle.h"
 #include "../ast/decl.h"
 
@@ -62,3 +71,331 @@ std::string delta::mangle(const TypeDecl& decl, llvm::ArrayRef<Type> genericArgs
     appendGenericArgs(mangled, genericArgs);
     return mangled;
 }
+
+namespace {
+
+/// The single-letter codes of the builtin types in the names produced by mangleSymbol().
+const std::pair<char, const char*> builtinTypeCodes[] = {
+    { 'v', "void" }, { 'b', "bool" }, { 'c', "char" }, { 'i', "int" }, { 'a', "int8" }, { 's', "int16" },
+    { 'l', "int32" }, { 'x', "int64" }, { 'j', "uint" }, { 'h', "uint8" }, { 't', "uint16" }, { 'm', "uint32" },
+    { 'y', "uint64" }, { 'f', "float" }, { 'o', "float32" }, { 'd', "float64" }, { 'e', "float80" },
+    { 'n', "null" },
+};
+
+const char base36Digits[] = "0123456789abcdefghijklmnopqrstuvwxyz";
+
+class SymbolMangler {
+public:
+    std::string mangle(const FunctionLikeDecl& decl, llvm::ArrayRef<Type> typeGenericArgs,
+                       llvm::ArrayRef<Type> functionGenericArgs) {
+        mangled = "_D";
+        if (auto* typeDecl = decl.getTypeDecl()) {
+            mangled += 'N';
+            mangleBasicType(typeDecl->getName(), typeGenericArgs);
+            mangleName(decl.getName());
+            mangleGenericArgs(functionGenericArgs);
+            mangled += 'E';
+        } else {
+            mangleName(decl.getName());
+            mangleGenericArgs(functionGenericArgs);
+        }
+        return std::move(mangled);
+    }
+
+private:
+    void mangleName(llvm::StringRef name) {
+        mangled += std::to_string(name.size());
+        mangled += name.str();
+    }
+
+    void mangleGenericArgs(llvm::ArrayRef<Type> genericArgs) {
+        if (genericArgs.empty()) return;
+
+        mangled += 'I';
+        for (Type genericArg : genericArgs) {
+            mangleType(genericArg);
+        }
+        mangled += 'E';
+    }
+
+    void mangleBasicType(llvm::StringRef name, llvm::ArrayRef<Type> genericArgs) {
+        if (genericArgs.empty()) {
+            for (auto& builtin : builtinTypeCodes) {
+                if (name == builtin.second) {
+                    mangled += builtin.first;
+                    return;
+                }
+            }
+        }
+
+        auto key = name.str();
+        appendGenericArgs(key, genericArgs);
+        if (mangleSubstitution(key)) return;
+
+        mangleName(name);
+        mangleGenericArgs(genericArgs);
+        addSubstitution(key);
+    }
+
+    void mangleType(Type type) {
+        if (type.isMutable()) mangled += 'V';
+        type = type.asImmutable();
+
+        if (type.isBasicType()) {
+            mangleBasicType(type.getName(), type.getGenericArgs());
+            return;
+        }
+
+        auto key = type.toString();
+        if (mangleSubstitution(key)) return;
+
+        switch (type.getKind()) {
+            case TypeKind::BasicType:
+                llvm_unreachable("handled above");
+            case TypeKind::ArrayType:
+                mangled += 'A';
+                if (!type.isUnsizedArrayType()) mangled += std::to_string(type.getArraySize());
+                mangled += '_';
+                mangleType(type.getElementType());
+                break;
+            case TypeKind::TupleType:
+                mangled += 'T';
+                for (Type subtype : type.getSubtypes()) {
+                    mangleType(subtype);
+                }
+                mangled += 'E';
+                break;
+            case TypeKind::FunctionType:
+                mangled += 'F';
+                mangleType(type.getReturnType());
+                for (Type paramType : type.getParamTypes()) {
+                    mangleType(paramType);
+                }
+                mangled += 'E';
+                break;
+            case TypeKind::PointerType:
+                mangled += type.isReference() ? 'R' : 'P';
+                mangleType(type.getPointee());
+                break;
+        }
+
+        addSubstitution(key);
+    }
+
+    bool mangleSubstitution(const std::string& key) {
+        auto it = substitutions.find(key);
+        if (it == substitutions.end()) return false;
+
+        mangled += 'S';
+        if (it->second > 0) {
+            std::string digits;
+            for (size_t index = it->second - 1;; index /= 36) {
+                digits.insert(digits.begin(), base36Digits[index % 36]);
+                if (index < 36) break;
+            }
+            mangled += digits;
+        }
+        mangled += '_';
+        return true;
+    }
+
+    /// Types are numbered in the order their encodings are completed, so that the demangler can number them
+    /// in the same order.
+    void addSubstitution(const std::string& key) {
+        substitutions.insert({ key, substitutions.size() });
+    }
+
+private:
+    std::string mangled;
+    llvm::StringMap<size_t> substitutions;
+};
+
+class SymbolDemangler {
+public:
+    explicit SymbolDemangler(llvm::StringRef input) : input(input) {}
+
+    /// Demangles the name at the start of the input, and returns its length, or 0 if there isn't one.
+    size_t demangle(std::string& demangled) {
+        auto start = input;
+        if (!input.consume_front("_D")) return 0;
+
+        if (input.consume_front("N")) {
+            DemangledType receiver;
+            std::string memberName;
+            if (!parseType(receiver) || !parseName(memberName)) return 0;
+            demangled = print(receiver) + "." + memberName;
+            if (!parseGenericArgs(demangled) || !input.consume_front("E")) return 0;
+        } else {
+            if (!parseName(demangled) || !parseGenericArgs(demangled)) return 0;
+        }
+
+        if (input.size() >= 17 && input[0] == 'H'
+            && std::all_of(input.begin() + 1, input.begin() + 17, [](char ch) { return std::isxdigit(ch); })) {
+            demangled += " (hash " + input.substr(1, 16).str() + ")";
+            input = input.drop_front(17);
+        }
+
+        return start.size() - input.size();
+    }
+
+private:
+    struct DemangledType {
+        std::string name; ///< The name without the top-level 'mutable'.
+        TypeKind kind;
+        bool isMutable;
+    };
+
+    static std::string print(const DemangledType& type, bool omitTopLevelMutable = false) {
+        if (!type.isMutable || omitTopLevelMutable) return type.name;
+
+        switch (type.kind) {
+            case TypeKind::BasicType:
+                return "mutable " + type.name;
+            case TypeKind::PointerType:
+                return "mutable(" + type.name + ")";
+            default:
+                return type.name;
+        }
+    }
+
+    bool parseName(std::string& name) {
+        unsigned long long length;
+        if (input.consumeInteger(10, length) || length == 0 || length > input.size()) return false;
+        name += input.take_front(length).str();
+        input = input.drop_front(length);
+        return true;
+    }
+
+    bool parseGenericArgs(std::string& demangled) {
+        if (!input.consume_front("I")) return true;
+
+        demangled += '<';
+        do {
+            DemangledType genericArg;
+            if (!parseType(genericArg)) return false;
+            if (demangled.back() != '<') demangled += ", ";
+            demangled += print(genericArg);
+        } while (!input.consume_front("E"));
+        demangled += '>';
+        return true;
+    }
+
+    bool parseType(DemangledType& type) {
+        if (input.empty()) return false;
+
+        if (input.consume_front("V")) {
+            if (!parseType(type)) return false;
+            type.isMutable = true;
+            return true;
+        }
+
+        type.isMutable = false;
+        char code = input.front();
+
+        for (auto& builtin : builtinTypeCodes) {
+            if (code == builtin.first) {
+                input = input.drop_front();
+                type.name = builtin.second;
+                type.kind = TypeKind::BasicType;
+                return true;
+            }
+        }
+
+        if (code == 'S') {
+            input = input.drop_front();
+            size_t index = 0;
+            if (!input.consume_front("_")) {
+                unsigned long long number;
+                if (input.consumeInteger(36, number) || !input.consume_front("_")) return false;
+                index = number + 1;
+            }
+            if (index >= substitutions.size()) return false;
+            type.name = substitutions[index].name;
+            type.kind = substitutions[index].kind;
+            return true;
+        }
+
+        if (std::isdigit(code)) {
+            type.name.clear();
+            if (!parseName(type.name) || !parseGenericArgs(type.name)) return false;
+            type.kind = TypeKind::BasicType;
+        } else if (code == 'P' || code == 'R') {
+            input = input.drop_front();
+            DemangledType pointee;
+            if (!parseType(pointee)) return false;
+            type.name = print(pointee) + (code == 'R' ? "&" : "*");
+            type.kind = TypeKind::PointerType;
+        } else if (code == 'A') {
+            input = input.drop_front();
+            auto size = input.take_while([](char ch) { return std::isdigit(ch); });
+            input = input.drop_front(size.size());
+            DemangledType elementType;
+            if (!input.consume_front("_") || !parseType(elementType)) return false;
+            type.name = print(elementType) + "[" + size.str() + "]";
+            type.kind = TypeKind::ArrayType;
+        } else if (code == 'T') {
+            input = input.drop_front();
+            type.name = "(";
+            while (!input.consume_front("E")) {
+                DemangledType subtype;
+                if (!parseType(subtype)) return false;
+                if (type.name.size() > 1) type.name += ", ";
+                type.name += print(subtype);
+            }
+            type.name += ")";
+            type.kind = TypeKind::TupleType;
+        } else if (code == 'F') {
+            input = input.drop_front();
+            DemangledType returnType;
+            if (!parseType(returnType)) return false;
+            type.name = "func(";
+            while (!input.consume_front("E")) {
+                DemangledType paramType;
+                if (!parseType(paramType)) return false;
+                if (type.name.size() > 5) type.name += ", ";
+                type.name += print(paramType, true);
+            }
+            type.name += ") -> " + print(returnType, true);
+            type.kind = TypeKind::FunctionType;
+        } else {
+            return false;
+        }
+
+        substitutions.push_back({ type.name, type.kind, false });
+        return true;
+    }
+
+private:
+    llvm::StringRef input;
+    std::vector<DemangledType> substitutions;
+};
+
+} // anonymous namespace
+
+std::string delta::mangleSymbol(const FunctionLikeDecl& decl, llvm::ArrayRef<Type> typeGenericArgs,
+                                llvm::ArrayRef<Type> functionGenericArgs) {
+    auto symbol = SymbolMangler().mangle(decl, typeGenericArgs, functionGenericArgs);
+    if (symbol.size() <= maxSymbolLength) return symbol;
+
+    // Keep the names of the function and its receiver type readable, and identify the instantiation by a
+    // hash of the full name.
+    llvm::MD5 hash;
+    hash.update(symbol);
+    llvm::MD5::MD5Result result;
+    hash.final(result);
+    llvm::SmallString<32> hexHash;
+    llvm::MD5::stringifyResult(result, hexHash);
+    return SymbolMangler().mangle(decl, {}, {}) + "H" + hexHash.substr(0, 16).str();
+}
+
+size_t delta::demanglePrefix(llvm::StringRef text, std::string& demangled) {
+    auto length = SymbolDemangler(text).demangle(demangled);
+    if (length == 0) demangled.clear();
+    return length;
+}
+
+std::string delta::demangle(llvm::StringRef symbol) {
+    std::string demangled;
+    if (demanglePrefix(symbol, demangled) != symbol.size()) return symbol.str();
+    return demangled;
+}
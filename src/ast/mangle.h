@@ -30,4 +30,32 @@ std::string mangle(const DeinitDecl& decl, llvm::ArrayRef<Type> typeGenericArgs
 std::string mangleDeinitDecl(llvm::StringRef typeName);
 std::string mangle(const TypeDecl& decl, llvm::ArrayRef<Type> genericArgs);
 
+/// Returns the symbol name of an instantiation of `decl`. The names above are used as symbol names for
+/// non-generic functions, but they embed the full names of the generic arguments, which grow quickly for
+/// nested generic types. Generic instantiations instead get a compact, length-prefixed name in the style of
+/// the Itanium C++ ABI:
+///
+///   <symbol>       ::= "_D" <entity> ["H" <hash>]
+///   <entity>       ::= <name> [<generic-args>] | "N" <type> <name> [<generic-args>] "E"
+///   <name>         ::= <length> <identifier>
+///   <generic-args> ::= "I" <type>+ "E"
+///   <type>         ::= "V" <type> | <builtin> | <name> [<generic-args>] | "P" <type> | "R" <type>
+///                    | "A" [<size>] "_" <type> | "T" <type>* "E" | "F" <type>+ "E" | <substitution>
+///   <substitution> ::= "S_" | "S" <base-36 number> "_"
+///
+/// "V" marks a mutable type, "P" a pointer, "R" a reference, "A" an array, "T" a tuple, and "F" a function
+/// type starting with the return type. Each non-builtin type is numbered once encoded, and later
+/// occurrences of it are encoded as a substitution referring back to it. If the name would be longer than
+/// maxSymbolLength, the generic arguments are replaced with a hash of the full name.
+std::string mangleSymbol(const FunctionLikeDecl& decl, llvm::ArrayRef<Type> typeGenericArgs,
+                         llvm::ArrayRef<Type> functionGenericArgs);
+/// Returns the readable form of a name produced by mangleSymbol(), e.g. 'Array<int>.append', or `symbol`
+/// itself if it isn't one.
+std::string demangle(llvm::StringRef symbol);
+/// Demangles the name produced by mangleSymbol() at the start of `text` into `demangled`, and returns its
+/// length, or 0 if `text` doesn't start with one.
+size_t demanglePrefix(llvm::StringRef text, std::string& demangled);
+
+const size_t maxSymbolLength = 200;
+
 }
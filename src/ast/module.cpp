@@ -0,0 +1,25 @@
+#include "module.h"
+#include <llvm/ADT/Statistic.h>
+
+#define DEBUG_TYPE "ast"
+
+STATISTIC(NumSymbolTableLookups, "Number of SymbolTable::find calls");
+STATISTIC(MaxScopeDepth, "Maximum symbol table scope depth");
+
+using namespace delta;
+
+void SymbolTable::pushScope() {
+    scopes.emplace_back();
+    if (scopes.size() > MaxScopeDepth) MaxScopeDepth = scopes.size();
+}
+
+llvm::ArrayRef<Decl*> SymbolTable::find(const std::string& name) const {
+    ++NumSymbolTableLookups;
+    auto realName = applyIdentifierReplacements(name);
+
+    for (const auto& scope : llvm::reverse(scopes)) {
+        auto it = scope.find(realName);
+        if (it != scope.end()) return it->second;
+    }
+    return {};
+}
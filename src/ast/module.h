@@ -22,6 +22,11 @@ public:
     llvm::StringRef getFilePath() const { return filePath; }
     llvm::ArrayRef<std::shared_ptr<Module>> getImportedModules() const { return importedModules; }
     void setDecls(std::vector<std::unique_ptr<Decl>>&& decls) { topLevelDecls = std::move(decls); }
+    void addDecl(std::unique_ptr<Decl> decl) { topLevelDecls.emplace_back(std::move(decl)); }
+    /// Removes the top-level declarations after the first `count` ones.
+    void removeDeclsAfter(size_t count) {
+        topLevelDecls.erase(topLevelDecls.begin() + count, topLevelDecls.end());
+    }
 
     void addImportedModule(std::shared_ptr<Module> module) {
         if (!llvm::is_contained(importedModules, module)) {
@@ -38,7 +43,7 @@ private:
 class SymbolTable {
 public:
     SymbolTable() : scopes(1) {}
-    void pushScope() { scopes.emplace_back(); }
+    void pushScope();
     void popScope() { scopes.pop_back(); }
     void add(llvm::StringRef name, Decl* decl) { scopes.back()[name].push_back(decl); }
     void addIdentifierReplacement(llvm::StringRef name, llvm::StringRef replacement) {
@@ -46,15 +51,7 @@ public:
     }
     bool contains(const std::string& name) const { return !find(name).empty(); }
 
-    llvm::ArrayRef<Decl*> find(const std::string& name) const {
-        auto realName = applyIdentifierReplacements(name);
-
-        for (const auto& scope : llvm::reverse(scopes)) {
-            auto it = scope.find(realName);
-            if (it != scope.end()) return it->second;
-        }
-        return {};
-    }
+    llvm::ArrayRef<Decl*> find(const std::string& name) const;
 
     template<typename T>
     T* findWithMatchingParams(const T& toFind) const {
@@ -95,6 +92,18 @@ public:
     llvm::StringRef getName() const { return name; }
     const SymbolTable& getSymbolTable() const { return symbolTable; }
     SymbolTable& getSymbolTable() { return symbolTable; }
+    /// For modules imported from C headers, returns the paths of the headers that were read,
+    /// including the transitively included ones.
+    llvm::ArrayRef<std::string> getHeaderFiles() const { return headerFiles; }
+    void addHeaderFile(llvm::StringRef filePath) { headerFiles.emplace_back(filePath); }
+    /// For imported Delta modules, returns the directory containing their source files, even if the module
+    /// was parsed from its module interface. Returns an empty string for other modules.
+    llvm::StringRef getSourceDirectory() const { return sourceDirectory; }
+    void setSourceDirectory(llvm::StringRef directoryPath) { sourceDirectory = directoryPath; }
+    /// For modules imported from module interfaces, returns the path of the prebuilt library or object file
+    /// that contains the code of their non-generic functions. Returns an empty string for other modules.
+    llvm::StringRef getLibraryPath() const { return libraryPath; }
+    void setLibraryPath(llvm::StringRef filePath) { libraryPath = filePath; }
 
     std::vector<Module*> getImportedModules() const {
         std::vector<Module*> importedModules;
@@ -109,6 +118,9 @@ public:
 private:
     std::string name;
     std::vector<SourceFile> sourceFiles;
+    std::vector<std::string> headerFiles;
+    std::string sourceDirectory;
+    std::string libraryPath;
     SymbolTable symbolTable;
 };
 
@@ -0,0 +1,36 @@
+#include "stmt.h"
+#include <llvm/ADT/Statistic.h>
+
+#define DEBUG_TYPE "ast"
+
+STATISTIC(NumReturnStmts, "Number of ReturnStmt nodes created");
+STATISTIC(NumVarStmts, "Number of VarStmt nodes created");
+STATISTIC(NumIncrementStmts, "Number of IncrementStmt nodes created");
+STATISTIC(NumDecrementStmts, "Number of DecrementStmt nodes created");
+STATISTIC(NumExprStmts, "Number of ExprStmt nodes created");
+STATISTIC(NumDeferStmts, "Number of DeferStmt nodes created");
+STATISTIC(NumIfStmts, "Number of IfStmt nodes created");
+STATISTIC(NumSwitchStmts, "Number of SwitchStmt nodes created");
+STATISTIC(NumWhileStmts, "Number of WhileStmt nodes created");
+STATISTIC(NumForStmts, "Number of ForStmt nodes created");
+STATISTIC(NumBreakStmts, "Number of BreakStmt nodes created");
+STATISTIC(NumAssignStmts, "Number of AssignStmt nodes created");
+
+using namespace delta;
+
+Stmt::Stmt(StmtKind kind) : kind(kind) {
+    switch (kind) {
+        case StmtKind::ReturnStmt:    ++NumReturnStmts; break;
+        case StmtKind::VarStmt:       ++NumVarStmts; break;
+        case StmtKind::IncrementStmt: ++NumIncrementStmts; break;
+        case StmtKind::DecrementStmt: ++NumDecrementStmts; break;
+        case StmtKind::ExprStmt:      ++NumExprStmts; break;
+        case StmtKind::DeferStmt:     ++NumDeferStmts; break;
+        case StmtKind::IfStmt:        ++NumIfStmts; break;
+        case StmtKind::SwitchStmt:    ++NumSwitchStmts; break;
+        case StmtKind::WhileStmt:     ++NumWhileStmts; break;
+        case StmtKind::ForStmt:       ++NumForStmts; break;
+        case StmtKind::BreakStmt:     ++NumBreakStmts; break;
+        case StmtKind::AssignStmt:    ++NumAssignStmts; break;
+    }
+}
@@ -44,7 +44,7 @@ public:
     StmtKind getKind() const { return kind; }
 
 protected:
-    Stmt(StmtKind kind) : kind(kind) {}
+    Stmt(StmtKind kind);
 
 private:
     const StmtKind kind;
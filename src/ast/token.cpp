@@ -38,9 +38,10 @@ PrecedenceGroup getPrecedenceGroup(TokenKind tokenKind) {
 }
 
 namespace delta {
-const char* currentFilePath;
-SourceLocation firstLocation(nullptr, 1, 0);
-SourceLocation lastLocation(nullptr, 1, 0);
+// The lexer state is thread-local so that multiple compilations can lex files concurrently.
+thread_local const char* currentFilePath;
+thread_local SourceLocation firstLocation(nullptr, 1, 0);
+thread_local SourceLocation lastLocation(nullptr, 1, 0);
 }
 
 Token::Token(TokenKind kind, llvm::StringRef string)
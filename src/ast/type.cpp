@@ -1,11 +1,21 @@
 #include <sstream>
+#include <llvm/ADT/Statistic.h>
 #include <llvm/ADT/StringRef.h>
 #include <llvm/ADT/STLExtras.h>
 #include <llvm/Support/ErrorHandling.h>
 #include "type.h"
+#include "compiler-instance.h"
 #include "type-resolver.h"
 #include "../support/utility.h"
 
+#define DEBUG_TYPE "ast"
+
+STATISTIC(NumBasicTypes, "Number of BasicTypes interned");
+STATISTIC(NumArrayTypes, "Number of ArrayTypes interned");
+STATISTIC(NumTupleTypes, "Number of TupleTypes interned");
+STATISTIC(NumFunctionTypes, "Number of FunctionTypes interned");
+STATISTIC(NumPointerTypes, "Number of PointerTypes interned");
+
 using namespace delta;
 
 #define DEFINE_BUILTIN_TYPE_GET_AND_IS(TYPE, NAME) \
@@ -70,19 +80,13 @@ void Type::appendType(Type type) {
     typeBase = TupleType::get(std::move(subtypes)).get();
 }
 
-namespace {
-std::vector<std::unique_ptr<BasicType>> basicTypes;
-std::vector<std::unique_ptr<ArrayType>> arrayTypes;
-std::vector<std::unique_ptr<TupleType>> tupleTypes;
-std::vector<std::unique_ptr<FunctionType>> functionTypes;
-std::vector<std::unique_ptr<PointerType>> ptrTypes;
-}
-
 #define FETCH_AND_RETURN_TYPE(TYPE, CACHE, EQUALS, ...) \
-    auto it = llvm::find_if(CACHE, [&](const std::unique_ptr<TYPE>& t) { return EQUALS; }); \
-    if (it != CACHE.end()) return Type(it->get(), isMutable); \
-    CACHE.emplace_back(new TYPE(__VA_ARGS__)); \
-    return Type(CACHE.back().get(), isMutable);
+    auto& cache = CompilerInstance::getCurrent().getTypeTable().CACHE; \
+    auto it = llvm::find_if(cache, [&](const std::unique_ptr<TYPE>& t) { return EQUALS; }); \
+    if (it != cache.end()) return Type(it->get(), isMutable); \
+    ++Num##TYPE##s; \
+    cache.emplace_back(new TYPE(__VA_ARGS__)); \
+    return Type(cache.back().get(), isMutable);
 
 Type BasicType::get(llvm::StringRef name, llvm::ArrayRef<Type> genericArgs, bool isMutable) {
     FETCH_AND_RETURN_TYPE(BasicType, basicTypes,
@@ -106,7 +110,7 @@ Type FunctionType::get(Type returnType, std::vector<Type>&& paramTypes, bool isM
 }
 
 Type PointerType::get(Type pointeeType, bool isReference, bool isMutable) {
-    FETCH_AND_RETURN_TYPE(PointerType, ptrTypes,
+    FETCH_AND_RETURN_TYPE(PointerType, pointerTypes,
                           t->getPointeeType() == pointeeType && t->isReference() == isReference,
                           pointeeType, isReference);
 }
@@ -0,0 +1,61 @@
+#include <cctype>
+#include <iostream>
+#include <string>
+#include <llvm/ADT/ArrayRef.h>
+#include <llvm/ADT/StringRef.h>
+#include <llvm/Support/raw_ostream.h>
+#include "../ast/mangle.h"
+
+using namespace delta;
+
+/// Replaces the symbol names produced by mangleSymbol() in `text` with their readable forms.
+static std::string demangleText(llvm::StringRef text) {
+    std::string result;
+
+    while (!text.empty()) {
+        auto start = text.find("_D");
+        if (start == llvm::StringRef::npos) break;
+
+        // Mangled names only start at the beginning of an identifier.
+        if (start > 0 && (std::isalnum(text[start - 1]) || text[start - 1] == '_')) {
+            result += text.take_front(start + 2).str();
+            text = text.drop_front(start + 2);
+            continue;
+        }
+
+        result += text.take_front(start).str();
+        text = text.drop_front(start);
+        std::string demangled;
+        if (auto length = demanglePrefix(text, demangled)) {
+            result += demangled;
+            text = text.drop_front(length);
+        } else {
+            result += text.take_front(2).str();
+            text = text.drop_front(2);
+        }
+    }
+
+    return result + text.str();
+}
+
+int main(int argc, const char** argv) {
+    if (argc > 1 && (llvm::StringRef(argv[1]) == "-help" || llvm::StringRef(argv[1]) == "--help")) {
+        llvm::outs() << "Usage: delta-demangle [symbols...]\n\n"
+                        "Prints the readable forms of the given symbol names, or if none are given, copies the\n"
+                        "standard input to the standard output with the symbol names in it demangled.\n";
+        return 0;
+    }
+
+    for (int i = 1; i < argc; ++i) {
+        llvm::outs() << demangle(argv[i]) << '\n';
+    }
+
+    if (argc == 1) {
+        std::string line;
+        while (std::getline(std::cin, line)) {
+            llvm::outs() << demangleText(line) << '\n';
+        }
+    }
+
+    return 0;
+}
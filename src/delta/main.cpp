@@ -3,8 +3,11 @@
 #include <llvm/ADT/ArrayRef.h>
 #include <llvm/ADT/StringRef.h>
 #include <llvm/Support/raw_ostream.h>
+#include "../ast/compiler-instance.h"
 #include "../driver/driver.h"
+#include "../driver/prebuilt-stdlib.h"
 #include "../driver/repl.h"
+#include "../driver/server.h"
 #include "../support/utility.h"
 
 using namespace delta;
@@ -13,7 +16,9 @@ static std::vector<std::string> removeFileArgs(std::vector<llvm::StringRef>& arg
     std::vector<std::string> files;
 
     for (auto arg = args.begin(); arg != args.end();) {
-        if (!arg->startswith("-")) {
+        if (*arg == "-MF" && std::next(arg) != args.end()) {
+            arg += 2; // Skip the option's argument.
+        } else if (!arg->startswith("-")) {
             files.push_back(*arg);
             arg = args.erase(arg);
         } else {
@@ -30,40 +35,71 @@ static void printHelp() {
         "\n"
         "USAGE: delta [options] <inputs>\n"
         "\n"
+        "Inputs can be Delta source files, C source files (.c), LLVM IR or bitcode files\n"
+        "(.ll, .bc), and object files or libraries (.o, .a, .so).\n"
+        "\n"
+        "Run 'delta serve [-socket=<path>] [-preload=<header>...]' to start a compiler server that\n"
+        "keeps the standard library and C headers loaded. Commands run with DELTA_SERVER_SOCKET set\n"
+        "to the server's socket path are forwarded to it.\n"
+        "\n"
+        "Run 'delta build-stdlib <directory>' to precompile the standard library into binary module\n"
+        "interfaces (.deltai) and an object file for libdelta_std.a. This is done by the 'stdlib' build\n"
+        "target.\n"
+        "\n"
         "OPTIONS:\n"
+        "  -build-dir=<dir>      - Compile incrementally, reusing unchanged outputs in <dir>\n"
         "  -c                    - Compile only, generating an .o file; don't link\n"
         "  -emit-assembly        - Emit assembly code\n"
+        "  -emit-bitcode         - Emit LLVM bitcode (.bc) instead of an object file\n"
+        "  -flto                 - Optimize Delta, C, and LLVM IR inputs together at link time\n"
         "  -fPIC                 - Emit position-independent code\n"
+        "  -fprofile-generate    - Instrument the executable to write a profile to default.profraw\n"
+        "  -fprofile-use=<file>  - Use the given merged profile (.profdata) to guide optimizations\n"
+        "  -ftime-report         - Print the time spent in each compilation phase to stderr\n"
+        "  -ftime-trace=<file>   - Write the compilation phase timings as a Chrome trace (JSON) to <file>\n"
         "  -help                 - Display this help\n"
         "  -I<directory>         - Add a search path for module and C header import\n"
+        "  -j[<N>]               - Compile modules separately, emitting machine code on <N> threads\n"
+        "  -jit                  - Run the program in-process with a JIT compiler ('delta run' only)\n"
+        "  -march=native         - Generate code for the host CPU and its features\n"
+        "  -mattr=<features>     - Enable (+feature) or disable (-feature) target features\n"
+        "  -MD                   - Write a Makefile-style dependency file listing all files read\n"
+        "  -MF <file>            - Write the dependency file to <file> instead of <output>.d\n"
+        "  -mcpu=<cpu>           - Generate code for the given CPU\n"
+        "  -memory-budget=<MB>   - Warn if the peak memory usage exceeds <MB>\n"
+        "  -no-cache             - Don't reuse or cache the executable built by 'delta run'\n"
+        "  -O0/-O1/-O2/-O3       - Set the optimization level (default: -O0)\n"
+        "  -Ofast-compile        - Minimize compile time, only compiling code reachable from main\n"
+        "  -Os/-Oz               - Optimize for code size\n"
         "  -parse                - Perform parsing\n"
         "  -print-ast            - Print the abstract syntax tree to stdout\n"
         "  -print-ir             - Print the generated LLVM IR to stdout\n"
-        "  -typecheck            - Perform parsing and type checking\n";
+        "  -print-ir-before-opt  - Print the generated LLVM IR to stdout before optimization\n"
+        "  -print-memory-stats   - Print the memory usage of each compilation phase to stderr\n"
+        "  -stats                - Print compiler statistics as JSON to stderr\n"
+        "  -stream-functions     - Parse and compile one function body at a time to reduce memory usage\n"
+        "  -typecheck            - Perform parsing and type checking\n"
+        "  -typecheck-all        - Type-check all functions of imported modules, not only the called ones\n";
 }
 
-int main(int argc, const char** argv) {
-    --argc;
-    ++argv;
-
-    if (argc == 0) {
-        return replMain();
-    }
-
+static int runCommand(int argc, const char** argv, CompilerInstance& compiler) {
     llvm::StringRef command = argv[0];
 
     try {
         if (command == "build") {
             std::vector<llvm::StringRef> args(argv + 1, argv + argc);
-            return buildPackage(".", args, /* run */ false);
+            return buildPackage(".", args, /* run */ false, compiler);
+        } else if (command == "build-stdlib") {
+            if (argc != 2) printErrorAndExit("usage: delta build-stdlib <directory>");
+            return buildPrebuiltStdlib(argv[1], compiler);
         } else if (command == "run") {
             std::vector<llvm::StringRef> args(argv + 1, argv + argc);
             auto files = removeFileArgs(args);
 
             if (files.empty()) {
-                return buildPackage(".", args, /* run */ true);
+                return buildPackage(".", args, /* run */ true, compiler);
             } else {
-                return buildExecutable(files, /* manifest */ nullptr, args, /* run */ true);
+                return buildExecutable(files, /* manifest */ nullptr, args, /* run */ true, compiler);
             }
         } else {
             std::vector<llvm::StringRef> args(argv, argv + argc);
@@ -74,10 +110,31 @@ int main(int argc, const char** argv) {
             }
 
             auto files = removeFileArgs(args);
-            return buildExecutable(files, /* manifest */ nullptr, args, /* run */ false);
+            return buildExecutable(files, /* manifest */ nullptr, args, /* run */ false, compiler);
         }
     } catch (const CompileError& error) {
         error.print();
         return 1;
     }
 }
+
+int main(int argc, const char** argv) {
+    --argc;
+    ++argv;
+
+    if (argc == 0) {
+        return replMain();
+    }
+
+    if (llvm::StringRef(argv[0]) == "serve") {
+        std::vector<llvm::StringRef> args(argv + 1, argv + argc);
+        return serveMain(args, runCommand);
+    }
+
+    if (auto exitStatus = forwardToServer(argc, argv)) {
+        return *exitStatus;
+    }
+
+    CompilerInstance compiler;
+    return runCommand(argc, argv, compiler);
+}
@@ -0,0 +1,110 @@
+#include <llvm/ADT/StringRef.h>
+#include <llvm/Bitcode/BitcodeReader.h>
+#include <llvm/Bitcode/BitcodeWriter.h>
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/IR/Module.h>
+#include <llvm/Support/Error.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/raw_ostream.h>
+#include "codegen-pipeline.h"
+#include "../support/timing.h"
+#include "../support/utility.h"
+
+using namespace delta;
+
+CodegenPipeline::CodegenPipeline(unsigned threadCount, TargetCPU targetCPU, llvm::Reloc::Model relocModel,
+                                 OptimizationLevel optimizationLevel, bool fastCompile,
+                                 std::string profileGenerateFile, std::string profileUseFile)
+: targetCPU(std::move(targetCPU)), relocModel(relocModel), optimizationLevel(optimizationLevel),
+  fastCompile(fastCompile), profileGenerateFile(std::move(profileGenerateFile)),
+  profileUseFile(std::move(profileUseFile)), unfinishedJobCount(0), isShuttingDown(false) {
+    for (unsigned i = 0; i < threadCount; ++i) {
+        workers.emplace_back(&CodegenPipeline::runWorker, this);
+    }
+}
+
+CodegenPipeline::~CodegenPipeline() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        isShuttingDown = true;
+    }
+    jobAdded.notify_all();
+
+    // The workers finish the remaining jobs before exiting.
+    for (auto& worker : workers) {
+        worker.join();
+    }
+}
+
+void CodegenPipeline::addModule(llvm::Module& module, std::string objectFilePath) {
+    if (workers.empty()) {
+        compile(module, objectFilePath);
+        return;
+    }
+
+    Job job;
+    job.moduleName = module.getModuleIdentifier();
+    job.objectFilePath = std::move(objectFilePath);
+    {
+        TimeScope timeScope("Serialize IR", job.moduleName);
+        llvm::raw_svector_ostream stream(job.bitcode);
+        llvm::WriteBitcodeToFile(&module, stream);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        jobs.push_back(std::move(job));
+        unfinishedJobCount++;
+    }
+    jobAdded.notify_one();
+}
+
+void CodegenPipeline::wait() {
+    std::unique_lock<std::mutex> lock(mutex);
+    jobFinished.wait(lock, [&] { return unfinishedJobCount == 0; });
+}
+
+void CodegenPipeline::runWorker() {
+    while (true) {
+        Job job;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            jobAdded.wait(lock, [&] { return !jobs.empty() || isShuttingDown; });
+            if (jobs.empty()) return;
+            job = std::move(jobs.front());
+            jobs.pop_front();
+        }
+
+        {
+            llvm::LLVMContext context;
+            llvm::MemoryBufferRef bitcode(llvm::StringRef(job.bitcode.data(), job.bitcode.size()), job.moduleName);
+            auto module = llvm::parseBitcodeFile(bitcode, context);
+            if (!module) {
+                printErrorAndExit("couldn't load the IR of '", job.moduleName, "': ",
+                                  llvm::toString(module.takeError()));
+            }
+            compile(**module, job.objectFilePath);
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            unfinishedJobCount--;
+        }
+        jobFinished.notify_all();
+    }
+}
+
+void CodegenPipeline::compile(llvm::Module& module, llvm::StringRef objectFilePath) const {
+    auto targetMachine = createTargetMachine(module, targetCPU, relocModel, optimizationLevel, fastCompile);
+    optimizeModule(module, *targetMachine, optimizationLevel, /* isWholeProgram */ false, profileGenerateFile,
+                   profileUseFile);
+
+    llvm::SmallVector<char, 0> objectFile;
+    emitMachineCode(module, *targetMachine, objectFile, llvm::TargetMachine::CGFT_ObjectFile);
+
+    std::error_code error;
+    llvm::raw_fd_ostream file(objectFilePath, error, llvm::sys::fs::F_None);
+    if (error) printErrorAndExit("couldn't write '", objectFilePath, "': ", error.message());
+    file.write(objectFile.data(), objectFile.size());
+}
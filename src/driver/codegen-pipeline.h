@@ -0,0 +1,69 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <llvm/ADT/SmallVector.h>
+#include <llvm/Support/CodeGen.h>
+#include "compile.h"
+
+namespace llvm {
+class Module;
+class StringRef;
+}
+
+namespace delta {
+
+/// Optimizes LLVM modules and emits them as object files on worker threads, so that machine code for one
+/// module is generated while the IR of the next module is still being generated on the calling thread.
+/// An LLVMContext can only be used by one thread at a time, so each module is handed over as bitcode,
+/// which the worker loads into a context of its own. With zero threads, modules are compiled directly
+/// on the calling thread when they're added.
+class CodegenPipeline {
+public:
+    CodegenPipeline(unsigned threadCount, TargetCPU targetCPU, llvm::Reloc::Model relocModel,
+                    OptimizationLevel optimizationLevel, bool fastCompile, std::string profileGenerateFile,
+                    std::string profileUseFile);
+    /// Waits for the remaining modules to be compiled.
+    ~CodegenPipeline();
+    CodegenPipeline(const CodegenPipeline&) = delete;
+    CodegenPipeline& operator=(const CodegenPipeline&) = delete;
+
+    /// Queues `module` to be optimized and written to `objectFilePath`. The module isn't referenced after
+    /// this returns, so the caller can destroy it.
+    void addModule(llvm::Module& module, std::string objectFilePath);
+    /// Blocks until all added modules have been written to their object files.
+    void wait();
+
+private:
+    struct Job {
+        std::string moduleName;
+        llvm::SmallVector<char, 0> bitcode;
+        std::string objectFilePath;
+    };
+
+    void runWorker();
+    void compile(llvm::Module& module, llvm::StringRef objectFilePath) const;
+
+private:
+    TargetCPU targetCPU;
+    llvm::Reloc::Model relocModel;
+    OptimizationLevel optimizationLevel;
+    bool fastCompile;
+    std::string profileGenerateFile;
+    std::string profileUseFile;
+
+    std::vector<std::thread> workers;
+    std::deque<Job> jobs;
+    /// The number of added modules that haven't been written to their object files yet.
+    unsigned unfinishedJobCount;
+    bool isShuttingDown;
+    std::mutex mutex;
+    std::condition_variable jobAdded;
+    std::condition_variable jobFinished;
+};
+
+}
@@ -0,0 +1,332 @@
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <llvm/ADT/ArrayRef.h>
+#include <llvm/ADT/Statistic.h>
+#include <llvm/ADT/StringMap.h>
+#include <llvm/ADT/StringRef.h>
+#include <llvm/Analysis/TargetTransformInfo.h>
+#include <llvm/IR/Module.h>
+#include <llvm/Object/ObjectFile.h>
+#include <llvm/Support/Host.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/raw_ostream.h>
+#include <llvm/Support/TargetRegistry.h>
+#include <llvm/Support/TargetSelect.h>
+#include <llvm/Transforms/IPO.h>
+#include <llvm/Transforms/IPO/PassManagerBuilder.h>
+#include <llvm/Transforms/Utils/Cloning.h>
+#include "compile.h"
+#include "../ast/compiler-instance.h"
+#include "../ast/module.h"
+#include "../irgen/irgen.h"
+#include "../parser/parse.h"
+#include "../sema/typecheck.h"
+#include "../support/timing.h"
+#include "../support/utility.h"
+
+#define DEBUG_TYPE "codegen"
+
+STATISTIC(NumInstructionsEmitted, "Number of LLVM instructions passed to machine code emission");
+STATISTIC(NumIdenticalFunctionsFolded, "Number of function bodies folded into an identical function");
+STATISTIC(NumInstructionsFolded, "Number of LLVM instructions removed by folding identical functions");
+STATISTIC(NumTextBytesFolded, "Number of bytes of machine code removed by folding identical functions");
+STATISTIC(NumSkippedFunctionBodiesReleased, "Number of skipped function bodies released after compilation");
+
+using namespace delta;
+
+namespace {
+
+llvm::CodeGenOpt::Level getCodeGenOptLevel(OptimizationLevel level) {
+    switch (level.speed) {
+        case 0: return llvm::CodeGenOpt::None;
+        case 1: return llvm::CodeGenOpt::Less;
+        case 2: return llvm::CodeGenOpt::Default;
+        default: return llvm::CodeGenOpt::Aggressive;
+    }
+}
+
+/// Parses and type-checks the given source files into `module`, and generates LLVM IR for it.
+llvm::Module& compileToIR(Module& module, std::vector<std::unique_ptr<llvm::MemoryBuffer>> sourceFiles,
+                          const CompileOptions& options, IRGenerator& irGenerator, CompilerInstance& compiler) {
+    for (auto& sourceFile : sourceFiles) {
+        parseSourceFile(std::move(sourceFile), module, compiler);
+    }
+
+    typecheckModuleAndImports(module, nullptr, options.importSearchPaths, compiler);
+    irGenerator.setTargetCPU(options.targetCPU.name, options.targetCPU.features);
+    return generateIR(module, irGenerator, compiler);
+}
+
+size_t countInstructions(const llvm::Function& function) {
+    size_t count = 0;
+    for (auto& basicBlock : function) {
+        count += basicBlock.size();
+    }
+    return count;
+}
+
+/// Returns the total size of the text sections of the object file emitted for a copy of `module`, as code
+/// generation modifies the IR it's run on.
+uint64_t getTextSize(const llvm::Module& module, llvm::TargetMachine& targetMachine) {
+    auto moduleCopy = llvm::CloneModule(&module);
+    llvm::SmallVector<char, 0> objectFile;
+    llvm::raw_svector_ostream stream(objectFile);
+    llvm::legacy::PassManager passManager;
+    if (targetMachine.addPassesToEmitFile(passManager, stream, llvm::TargetMachine::CGFT_ObjectFile)) return 0;
+    passManager.run(*moduleCopy);
+
+    auto object = llvm::object::ObjectFile::createObjectFile(
+        llvm::MemoryBufferRef(llvm::StringRef(objectFile.data(), objectFile.size()), module.getName()));
+    if (!object) {
+        llvm::consumeError(object.takeError());
+        return 0;
+    }
+
+    uint64_t textSize = 0;
+    for (auto& section : (*object)->sections()) {
+        if (section.isText()) textSize += section.getSize();
+    }
+    return textSize;
+}
+
+/// Folds the functions whose bodies are identical once lowered to LLVM types, such as the instantiations of
+/// a generic function for 'int32' and 'uint32' or for different pointer types, into a single body, and
+/// records the number of folded functions and instructions and the machine code size saved.
+void foldIdenticalFunctions(llvm::Module& module, llvm::TargetMachine& targetMachine) {
+    TimeScope timeScope("Fold identical functions", module.getModuleIdentifier());
+
+    // Folded functions are deleted, or replaced with a thunk of the same name that calls the remaining body.
+    llvm::StringMap<size_t> instructionCounts;
+    uint64_t textSizeBeforeFolding = 0;
+    if (llvm::AreStatisticsEnabled()) {
+        for (auto& function : module) {
+            if (!function.isDeclaration()) instructionCounts[function.getName()] = countInstructions(function);
+        }
+        // The module is only emitted an extra time before and after folding when statistics are requested.
+        textSizeBeforeFolding = getTextSize(module, targetMachine);
+    }
+
+    llvm::legacy::PassManager passManager;
+    passManager.add(llvm::createMergeFunctionsPass());
+    passManager.run(module);
+
+    for (auto& entry : instructionCounts) {
+        auto* function = module.getFunction(entry.getKey());
+        auto instructionCount = function && !function->isDeclaration() ? countInstructions(*function) : 0;
+        if (instructionCount < entry.getValue()) {
+            ++NumIdenticalFunctionsFolded;
+            NumInstructionsFolded += entry.getValue() - instructionCount;
+        }
+    }
+
+    if (textSizeBeforeFolding > 0) {
+        auto textSizeAfterFolding = getTextSize(module, targetMachine);
+        if (textSizeAfterFolding < textSizeBeforeFolding) {
+            NumTextBytesFolded += textSizeBeforeFolding - textSizeAfterFolding;
+        }
+    }
+}
+
+} // anonymous namespace
+
+void delta::typecheckModuleAndImports(Module& module, const PackageManifest* manifest,
+                                      llvm::ArrayRef<std::string> importSearchPaths, CompilerInstance& compiler) {
+    for (auto& importedModule : module.getImportedModules()) {
+        typecheckModule(*importedModule, /* TODO: Pass the manifest of `*importedModule` here. */ nullptr,
+                        importSearchPaths, parse, compiler, compiler.typechecksImportedBodiesOnDemand());
+    }
+    typecheckModule(module, manifest, importSearchPaths, parse, compiler);
+}
+
+llvm::Module& delta::generateIR(Module& module, IRGenerator& irGenerator, CompilerInstance& compiler) {
+    for (auto& importedModule : compiler.getImportedModules()) {
+        irGenerator.compile(*importedModule);
+    }
+    return irGenerator.compile(module);
+}
+
+std::unique_ptr<llvm::TargetMachine> delta::createTargetMachine(llvm::Module& module, const TargetCPU& targetCPU,
+                                                                llvm::Reloc::Model relocModel,
+                                                                OptimizationLevel optimizationLevel,
+                                                                bool fastCompile) {
+    // The target registry is process-wide, so initialize it only once even if multiple threads compile.
+    static std::once_flag targetInitialized;
+    std::call_once(targetInitialized, [] {
+        llvm::InitializeNativeTarget();
+        llvm::InitializeNativeTargetAsmPrinter();
+        llvm::InitializeNativeTargetAsmParser();
+    });
+
+    std::string targetTriple = llvm::sys::getDefaultTargetTriple();
+    module.setTargetTriple(targetTriple);
+
+    std::string errorMessage;
+    auto* target = llvm::TargetRegistry::lookupTarget(targetTriple, errorMessage);
+    if (!target) printErrorAndExit(errorMessage);
+
+    llvm::TargetOptions options;
+    options.EnableFastISel = fastCompile;
+    std::unique_ptr<llvm::TargetMachine> targetMachine(
+        target->createTargetMachine(targetTriple, targetCPU.name.empty() ? "generic" : targetCPU.name,
+                                    targetCPU.features, options, relocModel,
+                                    llvm::CodeModel::Default, getCodeGenOptLevel(optimizationLevel)));
+    module.setDataLayout(targetMachine->createDataLayout());
+    return targetMachine;
+}
+
+Optimizer::Optimizer(llvm::Module& module, llvm::TargetMachine& targetMachine, OptimizationLevel optimizationLevel,
+                     bool isWholeProgram, llvm::StringRef profileGenerateFile, llvm::StringRef profileUseFile)
+: module(module), enabled(optimizationLevel.speed > 0 || optimizationLevel.size > 0 ||
+                          !profileGenerateFile.empty() || !profileUseFile.empty()),
+  foldsIdenticalFunctions(optimizationLevel.size > 0), targetMachine(targetMachine),
+  functionPassManager(&module) {
+    if (!enabled) return;
+
+    llvm::PassManagerBuilder passManagerBuilder;
+    passManagerBuilder.OptLevel = optimizationLevel.speed;
+    passManagerBuilder.SizeLevel = optimizationLevel.size;
+    if (optimizationLevel.speed > 0) {
+        passManagerBuilder.Inliner = llvm::createFunctionInliningPass(optimizationLevel.speed,
+                                                                      optimizationLevel.size, false);
+    } else {
+        passManagerBuilder.Inliner = llvm::createAlwaysInlinerLegacyPass();
+    }
+    passManagerBuilder.LoopVectorize = optimizationLevel.speed > 1 && optimizationLevel.size < 2;
+    passManagerBuilder.SLPVectorize = optimizationLevel.speed > 1 && optimizationLevel.size < 2;
+    passManagerBuilder.EnablePGOInstrGen = !profileGenerateFile.empty();
+    passManagerBuilder.PGOInstrGen = profileGenerateFile;
+    passManagerBuilder.PGOInstrUse = profileUseFile;
+    targetMachine.adjustPassManager(passManagerBuilder);
+
+    functionPassManager.add(llvm::createTargetTransformInfoWrapperPass(targetMachine.getTargetIRAnalysis()));
+    passManagerBuilder.populateFunctionPassManager(functionPassManager);
+
+    modulePassManager.add(llvm::createTargetTransformInfoWrapperPass(targetMachine.getTargetIRAnalysis()));
+    passManagerBuilder.populateModulePassManager(modulePassManager);
+
+    if (isWholeProgram) {
+        modulePassManager.add(llvm::createInternalizePass([](const llvm::GlobalValue& value) {
+            return value.getName() == "main";
+        }));
+        passManagerBuilder.populateLTOPassManager(modulePassManager);
+    }
+
+    functionPassManager.doInitialization();
+}
+
+void Optimizer::optimizeFunction(llvm::Function& function) {
+    if (!enabled || !optimizedFunctions.insert(&function).second) return;
+    TimeScope timeScope("Optimize function", function.getName());
+    functionPassManager.run(function);
+}
+
+void Optimizer::finish() {
+    if (!enabled) return;
+    TimeScope timeScope("Optimize", module.getModuleIdentifier());
+
+    for (auto& function : module) {
+        optimizeFunction(function);
+    }
+    functionPassManager.doFinalization();
+
+    modulePassManager.run(module);
+    if (foldsIdenticalFunctions) foldIdenticalFunctions(module, targetMachine);
+}
+
+void delta::optimizeModule(llvm::Module& module, llvm::TargetMachine& targetMachine,
+                           OptimizationLevel optimizationLevel, bool isWholeProgram,
+                           llvm::StringRef profileGenerateFile, llvm::StringRef profileUseFile) {
+    Optimizer optimizer(module, targetMachine, optimizationLevel, isWholeProgram, profileGenerateFile,
+                        profileUseFile);
+    optimizer.finish();
+}
+
+void delta::compileDeferredFunctionBodies(Module& module, IRGenerator* irGenerator, Optimizer* optimizer,
+                                          CompilerInstance& compiler) {
+    for (auto& sourceFile : module.getSourceFiles()) {
+        TypeChecker typeChecker(&module, &sourceFile, compiler);
+
+        auto compileFunction = [&](FunctionLikeDecl& decl) {
+            if (!decl.hasDeferredBody()) return;
+            parseDeferredFunctionBody(decl, module);
+            {
+                TimeScope timeScope("Type-check function", decl.getName());
+                typeChecker.typecheckFunctionBody(decl);
+            }
+            if (irGenerator) {
+                auto& function = irGenerator->compileDeferredFunction(module, sourceFile, decl);
+                if (optimizer) optimizer->optimizeFunction(function);
+            }
+            decl.releaseBody();
+            ++NumSkippedFunctionBodiesReleased;
+        };
+
+        for (auto& decl : sourceFile.getTopLevelDecls()) {
+            if (auto* functionDecl = llvm::dyn_cast<FunctionDecl>(decl.get())) {
+                compileFunction(*functionDecl);
+            } else if (auto* typeDecl = llvm::dyn_cast<TypeDecl>(decl.get())) {
+                for (auto& memberDecl : typeDecl->getMemberDecls()) {
+                    compileFunction(*memberDecl);
+                }
+            }
+        }
+    }
+}
+
+void delta::removeUnreachableGlobals(llvm::Module& module) {
+    llvm::legacy::PassManager passManager;
+    passManager.add(llvm::createInternalizePass([](const llvm::GlobalValue& value) {
+        return value.getName() == "main";
+    }));
+    passManager.add(llvm::createGlobalDCEPass());
+    passManager.run(module);
+}
+
+void delta::emitMachineCode(llvm::Module& module, llvm::TargetMachine& targetMachine,
+                            llvm::SmallVectorImpl<char>& output, llvm::TargetMachine::CodeGenFileType fileType) {
+    TimeScope timeScope("Codegen", module.getModuleIdentifier());
+    for (auto& function : module) {
+        for (auto& basicBlock : function) {
+            NumInstructionsEmitted += basicBlock.size();
+        }
+    }
+
+    llvm::raw_svector_ostream stream(output);
+
+    llvm::legacy::PassManager passManager;
+    if (targetMachine.addPassesToEmitFile(passManager, stream, fileType)) {
+        printErrorAndExit("TargetMachine can't emit a file of this type");
+    }
+
+    passManager.run(module);
+}
+
+llvm::SmallVector<char, 0> delta::compileToObject(std::vector<std::unique_ptr<llvm::MemoryBuffer>> sourceFiles,
+                                                  const CompileOptions& options, CompilerInstance& compiler) {
+    Module module("main");
+    IRGenerator irGenerator(compiler);
+    auto& irModule = compileToIR(module, std::move(sourceFiles), options, irGenerator, compiler);
+
+    auto targetMachine = createTargetMachine(irModule, options.targetCPU, options.relocModel,
+                                             options.optimizationLevel, options.fastCompile);
+    optimizeModule(irModule, *targetMachine, options.optimizationLevel, /* isWholeProgram */ false, "", "");
+
+    llvm::SmallVector<char, 0> objectFile;
+    emitMachineCode(irModule, *targetMachine, objectFile, llvm::TargetMachine::CGFT_ObjectFile);
+    return objectFile;
+}
+
+JIT::ModuleHandle delta::compileToJIT(std::vector<std::unique_ptr<llvm::MemoryBuffer>> sourceFiles,
+                                      const CompileOptions& options, JIT& jit, CompilerInstance& compiler) {
+    Module module("main");
+    IRGenerator irGenerator(compiler);
+    auto& irModule = compileToIR(module, std::move(sourceFiles), options, irGenerator, compiler);
+
+    irModule.setTargetTriple(jit.getTargetMachine().getTargetTriple().str());
+    irModule.setDataLayout(jit.getDataLayout());
+    optimizeModule(irModule, jit.getTargetMachine(), options.optimizationLevel, /* isWholeProgram */ false,
+                   "", "");
+    return jit.addModule(irGenerator.takeModule());
+}
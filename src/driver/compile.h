@@ -0,0 +1,126 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <llvm/ADT/SmallPtrSet.h>
+#include <llvm/ADT/SmallVector.h>
+#include <llvm/IR/LegacyPassManager.h>
+#include <llvm/Support/CodeGen.h>
+#include <llvm/Target/TargetMachine.h>
+#include "jit.h"
+
+namespace llvm {
+template<typename T> class ArrayRef;
+class Function;
+class MemoryBuffer;
+class Module;
+class StringRef;
+}
+
+// The library interface for compiling Delta code in-process. Source files are given as memory buffers,
+// and imported modules and C headers are read through the file system of the CompilerInstance, which
+// can be an in-memory clang::vfs::InMemoryFileSystem. The output is an object file in memory or code
+// loaded into a JIT, so a compilation doesn't need to touch the real file system. Errors in the code
+// are reported by throwing CompileError.
+
+namespace delta {
+
+class CompilerInstance;
+class IRGenerator;
+class Module;
+class PackageManifest;
+
+struct OptimizationLevel {
+    /// Speed optimization level, from 0 to 3 as in '-O0' to '-O3'.
+    unsigned speed;
+    /// Size optimization level: 0 for none, 1 for '-Os', 2 for '-Oz'.
+    unsigned size;
+};
+
+struct TargetCPU {
+    /// The CPU name, or empty for a generic CPU.
+    std::string name;
+    /// Comma-separated list of target features in the form '+feature' or '-feature'.
+    std::string features;
+};
+
+struct CompileOptions {
+    /// Directories in which imported modules and C headers are looked up.
+    std::vector<std::string> importSearchPaths;
+    OptimizationLevel optimizationLevel = { 0, 0 };
+    TargetCPU targetCPU;
+    llvm::Reloc::Model relocModel = llvm::Reloc::Model::Static;
+    /// Selects instructions with FastISel to minimize compile time.
+    bool fastCompile = false;
+};
+
+/// Type-checks the modules imported by `module` during parsing, and then `module` itself, importing
+/// further modules and C headers from `importSearchPaths` as needed. The function bodies of the imported
+/// modules are type-checked on demand if CompilerInstance::typechecksImportedBodiesOnDemand() is true.
+void typecheckModuleAndImports(Module& module, const PackageManifest* manifest,
+                               llvm::ArrayRef<std::string> importSearchPaths, CompilerInstance& compiler);
+/// Generates LLVM IR for `module` and all modules imported into `compiler`.
+llvm::Module& generateIR(Module& module, IRGenerator& irGenerator, CompilerInstance& compiler);
+
+/// If `fastCompile` is true, the returned TargetMachine selects instructions with FastISel, which
+/// together with the fast register allocator used at CodeGenOpt::None minimizes compile time.
+std::unique_ptr<llvm::TargetMachine> createTargetMachine(llvm::Module& module, const TargetCPU& targetCPU,
+                                                         llvm::Reloc::Model relocModel,
+                                                         OptimizationLevel optimizationLevel,
+                                                         bool fastCompile);
+/// Runs the standard LLVM optimization pipeline for the given optimization level on `module`. When
+/// optimizing for size, functions with identical bodies, such as the instantiations of a generic function
+/// for types with the same machine layout, are then folded into one.
+/// If `isWholeProgram` is true, all symbols except 'main' are internalized and the link-time
+/// optimization pipeline is run as well. If `profileGenerateFile` is non-empty, the module is
+/// instrumented to write an execution profile to that file. If `profileUseFile` is non-empty,
+/// the profile data in that file is used to guide the optimizations.
+void optimizeModule(llvm::Module& module, llvm::TargetMachine& targetMachine,
+                    OptimizationLevel optimizationLevel, bool isWholeProgram,
+                    llvm::StringRef profileGenerateFile, llvm::StringRef profileUseFile);
+/// The pipeline run by optimizeModule(), split into the function passes, which can be run on each function
+/// as soon as its IR has been generated, and the module passes, which are run by finish().
+class Optimizer {
+public:
+    /// See optimizeModule() for the parameters.
+    Optimizer(llvm::Module& module, llvm::TargetMachine& targetMachine, OptimizationLevel optimizationLevel,
+              bool isWholeProgram, llvm::StringRef profileGenerateFile, llvm::StringRef profileUseFile);
+    /// Runs the function passes on `function` unless they have already been run on it.
+    void optimizeFunction(llvm::Function& function);
+    /// Runs the function passes on the remaining functions, and then the module passes.
+    void finish();
+
+private:
+    llvm::Module& module;
+    bool enabled;
+    bool foldsIdenticalFunctions;
+    llvm::TargetMachine& targetMachine;
+    llvm::legacy::FunctionPassManager functionPassManager;
+    llvm::legacy::PassManager modulePassManager;
+    llvm::SmallPtrSet<llvm::Function*, 64> optimizedFunctions;
+};
+
+/// Compiles the function bodies of `module` that were skipped by parseSignatures() one function at a time,
+/// after generateIR() has compiled the rest of the program: each body is parsed, type-checked, lowered
+/// with `irGenerator`, and passed to `optimizer`, and then released, so that only one function body is
+/// in memory at a time. If `irGenerator` is null, the bodies are only type-checked. If `optimizer` is
+/// null, the function passes are left to Optimizer::finish().
+void compileDeferredFunctionBodies(Module& module, IRGenerator* irGenerator, Optimizer* optimizer,
+                                   CompilerInstance& compiler);
+
+/// Removes the functions and global variables that are unreachable from 'main'.
+void removeUnreachableGlobals(llvm::Module& module);
+/// Appends the object code or assembly for `module` to `output`.
+void emitMachineCode(llvm::Module& module, llvm::TargetMachine& targetMachine, llvm::SmallVectorImpl<char>& output,
+                     llvm::TargetMachine::CodeGenFileType fileType);
+
+/// Compiles the given Delta source files into a single object file and returns its contents.
+llvm::SmallVector<char, 0> compileToObject(std::vector<std::unique_ptr<llvm::MemoryBuffer>> sourceFiles,
+                                           const CompileOptions& options, CompilerInstance& compiler);
+/// Compiles the given Delta source files and adds the generated code to `jit`, after which e.g. the
+/// address of 'main' can be looked up with JIT::getSymbolAddress().
+JIT::ModuleHandle compileToJIT(std::vector<std::unique_ptr<llvm::MemoryBuffer>> sourceFiles,
+                               const CompileOptions& options, JIT& jit, CompilerInstance& compiler);
+
+}
@@ -1,29 +1,50 @@
+#include <algorithm>
+#include <functional>
 #include <iostream>
+#include <memory>
 #include <string>
 #include <system_error>
+#include <thread>
 #include <vector>
+#include <llvm/ADT/Optional.h>
+#include <llvm/ADT/SmallPtrSet.h>
+#include <llvm/ADT/Statistic.h>
+#include <llvm/ADT/STLExtras.h>
+#include <llvm/ADT/StringMap.h>
 #include <llvm/ADT/StringRef.h>
 #include <llvm/ADT/StringSet.h>
-#include <llvm/IR/LegacyPassManager.h>
+#include <llvm/ADT/Triple.h>
+#include <llvm/Bitcode/BitcodeWriter.h>
 #include <llvm/IR/Module.h>
+#include <llvm/IRReader/IRReader.h>
+#include <llvm/Config/llvm-config.h>
+#include <llvm/Linker/Linker.h>
 #include <llvm/Support/CodeGen.h>
 #include <llvm/Support/ErrorOr.h>
 #include <llvm/Support/FileSystem.h>
+#include <llvm/Support/Host.h>
+#include <llvm/Support/MemoryBuffer.h>
 #include <llvm/Support/Path.h>
 #include <llvm/Support/Program.h>
 #include <llvm/Support/raw_ostream.h>
-#include <llvm/Support/TargetRegistry.h>
-#include <llvm/Support/TargetSelect.h>
+#include <llvm/Support/SourceMgr.h>
 #include <llvm/Target/TargetMachine.h>
 #include "driver.h"
+#include "codegen-pipeline.h"
+#include "compile.h"
+#include "incremental-build.h"
+#include "jit.h"
+#include "run-cache.h"
 #include "../ast/ast-printer.h"
+#include "../ast/compiler-instance.h"
 #include "../ast/module.h"
 #include "../irgen/irgen.h"
+#include "../support/memory-stats.h"
+#include "../support/timing.h"
 #include "../support/utility.h"
 #include "../package-manager/manifest.h"
 #include "../package-manager/package-manager.h"
 #include "../parser/parse.h"
-#include "../sema/typecheck.h"
 
 using namespace delta;
 
@@ -34,10 +55,8 @@ bool delta::checkFlag(llvm::StringRef flag, std::vector<llvm::StringRef>& args)
     return contains;
 }
 
-namespace {
-
-std::vector<std::string> collectStringOptionValues(llvm::StringRef flagPrefix,
-                                                   std::vector<llvm::StringRef>& args) {
+std::vector<std::string> delta::collectStringOptionValues(llvm::StringRef flagPrefix,
+                                                          std::vector<llvm::StringRef>& args) {
     std::vector<std::string> values;
     for (auto arg = args.begin(); arg != args.end();) {
         if (arg->startswith(flagPrefix)) {
@@ -50,58 +69,581 @@ std::vector<std::string> collectStringOptionValues(llvm::StringRef flagPrefix,
     return values;
 }
 
-void emitMachineCode(llvm::Module& module, llvm::StringRef fileName,
-                     llvm::TargetMachine::CodeGenFileType fileType,
-                     llvm::Reloc::Model relocModel) {
-    llvm::InitializeNativeTarget();
-    llvm::InitializeNativeTargetAsmPrinter();
-    llvm::InitializeNativeTargetAsmParser();
+namespace {
 
-    std::string targetTriple = llvm::sys::getDefaultTargetTriple();
-    module.setTargetTriple(targetTriple);
+/// Removes all occurrences of `flag` and the argument following it from `args`, and returns the
+/// argument following the last occurrence, or an empty string if there are none.
+std::string collectSeparateOptionValue(llvm::StringRef flag, std::vector<llvm::StringRef>& args) {
+    std::string value;
+    for (auto arg = args.begin(); arg != args.end();) {
+        if (*arg == flag) {
+            if (std::next(arg) == args.end()) printErrorAndExit("missing argument to '", flag, "'");
+            value = *std::next(arg);
+            arg = args.erase(arg, arg + 2);
+        } else {
+            ++arg;
+        }
+    }
+    return value;
+}
 
-    std::string errorMessage;
-    auto* target = llvm::TargetRegistry::lookupTarget(targetTriple, errorMessage);
-    if (!target) printErrorAndExit(errorMessage);
+/// Removes all '-O<level>' options from `args` and returns the level specified by the last one.
+OptimizationLevel collectOptimizationLevel(std::vector<llvm::StringRef>& args) {
+    OptimizationLevel level = { 0, 0 };
 
-    llvm::TargetOptions options;
-    auto* targetMachine = target->createTargetMachine(targetTriple, "generic", "", options,
-                                                      relocModel);
-    module.setDataLayout(targetMachine->createDataLayout());
+    for (auto arg = args.begin(); arg != args.end();) {
+        if (*arg == "-O0") level = { 0, 0 };
+        else if (*arg == "-O1") level = { 1, 0 };
+        else if (*arg == "-O2" || *arg == "-O") level = { 2, 0 };
+        else if (*arg == "-O3") level = { 3, 0 };
+        else if (*arg == "-Os") level = { 2, 1 };
+        else if (*arg == "-Oz") level = { 2, 2 };
+        else {
+            ++arg;
+            continue;
+        }
+        arg = args.erase(arg);
+    }
+
+    return level;
+}
 
+/// Removes the '-march=', '-mcpu=', and '-mattr=' options from `args` and returns the CPU they specify.
+TargetCPU collectTargetCPU(std::vector<llvm::StringRef>& args) {
+    TargetCPU targetCPU;
+
+    auto archs = collectStringOptionValues("-march=", args);
+    if (!archs.empty()) {
+        if (archs.back() != "native") {
+            printErrorAndExit("unsupported architecture '", archs.back(), "', only '-march=native' is supported");
+        }
+
+        targetCPU.name = llvm::sys::getHostCPUName();
+        llvm::StringMap<bool> hostFeatures;
+        if (llvm::sys::getHostCPUFeatures(hostFeatures)) {
+            for (auto& feature : hostFeatures) {
+                if (!targetCPU.features.empty()) targetCPU.features += ',';
+                targetCPU.features += feature.getValue() ? '+' : '-';
+                targetCPU.features += feature.getKey();
+            }
+        }
+    }
+
+    auto cpus = collectStringOptionValues("-mcpu=", args);
+    if (!cpus.empty()) targetCPU.name = cpus.back();
+
+    for (auto& features : collectStringOptionValues("-mattr=", args)) {
+        if (!targetCPU.features.empty()) targetCPU.features += ',';
+        targetCPU.features += features;
+    }
+
+    return targetCPU;
+}
+
+void writeFile(llvm::StringRef fileName, llvm::ArrayRef<char> contents) {
     std::error_code error;
     llvm::raw_fd_ostream file(fileName, error, llvm::sys::fs::F_None);
     if (error) printErrorAndExit(error.message());
 
-    llvm::legacy::PassManager passManager;
-    if (targetMachine->addPassesToEmitFile(passManager, file, fileType)) {
-        printErrorAndExit("TargetMachine can't emit a file of this type");
-    }
+    file.write(contents.data(), contents.size());
+    file.flush();
+}
 
-    passManager.run(module);
+void writeBitcode(llvm::Module& module, llvm::StringRef fileName) {
+    std::error_code error;
+    llvm::raw_fd_ostream file(fileName, error, llvm::sys::fs::F_None);
+    if (error) printErrorAndExit(error.message());
+
+    llvm::WriteBitcodeToFile(&module, file);
     file.flush();
 }
 
+/// Links the LLVM IR or bitcode files `irFiles` into `module`.
+void linkIRFiles(llvm::Module& module, llvm::ArrayRef<std::string> irFiles) {
+    for (auto& irFile : irFiles) {
+        llvm::SMDiagnostic diagnostic;
+        auto irFileModule = llvm::parseIRFile(irFile, diagnostic, module.getContext());
+        if (!irFileModule) {
+            diagnostic.print("delta", llvm::errs());
+            exit(1);
+        }
+
+        if (llvm::Linker::linkModules(module, std::move(irFileModule))) {
+            printErrorAndExit("couldn't link '", irFile, "'");
+        }
+    }
+}
+
+/// Returns the path of the Clang profile runtime library, which executables instrumented with
+/// -fprofile-generate must be linked with.
+std::string getProfileRuntimeLibraryPath() {
+    llvm::Triple triple(llvm::sys::getDefaultTargetTriple());
+    llvm::SmallString<128> path(CLANG_RUNTIME_LIBRARY_PATH);
+
+    if (triple.isOSDarwin()) {
+        llvm::sys::path::append(path, "darwin", "libclang_rt.profile_osx.a");
+    } else {
+        llvm::sys::path::append(path, triple.getOSName(), "libclang_rt.profile-" + triple.getArchName() + ".a");
+    }
+
+    return path.str();
+}
+
+std::string findCCompiler() {
+    llvm::ErrorOr<std::string> ccPath = llvm::sys::findProgramByName("cc");
+    if (!ccPath) {
+        printErrorAndExit("couldn't find C compiler");
+    }
+    return *ccPath;
+}
+
+/// Returns the major version of the C compiler at `ccPath` if it's Clang, or 0 otherwise.
+unsigned getClangMajorVersion(const std::string& ccPath) {
+    llvm::SmallString<128> outputFilePath;
+    if (llvm::sys::fs::createTemporaryFile("delta-cc-version", "txt", outputFilePath)) return 0;
+
+    const char* ccArgs[] = { ccPath.c_str(), "--version", nullptr };
+    llvm::StringRef noFile, outputFile = outputFilePath;
+    const llvm::StringRef* redirects[] = { &noFile, &outputFile, &noFile };
+    int exitStatus = llvm::sys::ExecuteAndWait(ccPath, ccArgs, nullptr, redirects);
+    auto output = llvm::MemoryBuffer::getFile(outputFilePath);
+    llvm::sys::fs::remove(outputFilePath);
+    if (exitStatus != 0 || !output) return 0;
+
+    // E.g. "clang version 5.0.1 (tags/RELEASE_501/final)".
+    llvm::StringRef versionPrefix = "clang version ";
+    auto version = (*output)->getBuffer();
+    auto position = version.find(versionPrefix);
+    if (position == llvm::StringRef::npos) return 0;
+    version = version.drop_front(position + versionPrefix.size());
+
+    unsigned majorVersion;
+    if (version.consumeInteger(10, majorVersion)) return 0;
+    return majorVersion;
+}
+
+/// Returns the path of a Clang that writes LLVM bitcode which the compiler can read, i.e. one whose version
+/// isn't newer than the LLVM version the compiler is built with. GCC can't write LLVM bitcode at all.
+std::string findBitcodeCompiler() {
+    std::string majorVersion = std::to_string(LLVM_VERSION_MAJOR);
+    std::string candidates[] = { "clang-" + majorVersion + "." + std::to_string(LLVM_VERSION_MINOR),
+                                 "clang-" + majorVersion, "clang", "cc" };
+
+    for (auto& candidate : candidates) {
+        auto ccPath = llvm::sys::findProgramByName(candidate);
+        if (!ccPath) continue;
+        auto clangMajorVersion = getClangMajorVersion(*ccPath);
+        if (clangMajorVersion != 0 && clangMajorVersion <= LLVM_VERSION_MAJOR) return *ccPath;
+    }
+
+    printErrorAndExit("compiling C sources with -flto requires Clang ", majorVersion,
+                      " or older to write compatible LLVM bitcode, but none was found");
+}
+
+/// Compiles the C source file `cFile` into a temporary file and returns the path of that file.
+/// If `emitBitcode` is true, the output is LLVM bitcode instead of an object file.
+std::string compileCFile(const std::string& ccPath, const std::string& cFile, bool emitBitcode,
+                         OptimizationLevel optimizationLevel) {
+    llvm::SmallString<128> outputFilePath;
+    if (auto error = llvm::sys::fs::createTemporaryFile("delta", emitBitcode ? "bc" : "o", outputFilePath)) {
+        printErrorAndExit(error.message());
+    }
+
+    std::string optimizationFlag = "-O" + std::to_string(optimizationLevel.speed);
+    if (optimizationLevel.size == 1) optimizationFlag = "-Os";
+    if (optimizationLevel.size == 2) optimizationFlag = "-Oz";
+
+    std::vector<const char*> ccArgs = {
+        ccPath.c_str(),
+        "-c",
+        optimizationFlag.c_str(),
+        cFile.c_str(),
+        "-o",
+        outputFilePath.c_str(),
+    };
+    if (emitBitcode) ccArgs.push_back("-emit-llvm");
+    ccArgs.push_back(nullptr);
+
+    TimeScope timeScope("Compile C file", cFile);
+    if (llvm::sys::ExecuteAndWait(ccArgs[0], ccArgs.data()) != 0) {
+        printErrorAndExit("couldn't compile '", cFile, "'", emitBitcode ? " to LLVM bitcode" : "");
+    }
+
+    return outputFilePath.str();
+}
+
+/// Compiles `module` with the JIT and calls its 'main' function in-process.
+int runWithJIT(std::unique_ptr<llvm::Module> module) {
+    JIT jit;
+    jit.addModule(std::move(module));
+
+    auto mainAddress = jit.getSymbolAddress("main");
+    if (!mainAddress) printErrorAndExit("couldn't find 'main' function");
+
+    auto* main = reinterpret_cast<int (*)()>(static_cast<intptr_t>(mainAddress));
+    return main();
+}
+
+int runExecutable(llvm::StringRef executablePath) {
+    std::string path = executablePath;
+    const char* executableArgs[] = { path.c_str(), nullptr };
+    return llvm::sys::ExecuteAndWait(executableArgs[0], executableArgs);
+}
+
+/// Returns the paths of the Delta source files, module interfaces, prebuilt libraries, and C headers that
+/// `module` and its transitive imports were built from. For modules imported from module interfaces, the
+/// source files the interfaces were generated from are included too, as editing them makes the interfaces
+/// out of date.
+std::vector<std::string> getInputFilePaths(const Module& module, const CompilerInstance& compiler) {
+    std::vector<std::string> filePaths;
+    auto addFilePaths = [&](const Module& module) {
+        for (auto& sourceFile : module.getSourceFiles()) {
+            filePaths.push_back(sourceFile.getFilePath());
+        }
+        if (!module.getLibraryPath().empty()) {
+            filePaths.push_back(module.getLibraryPath());
+
+            std::vector<std::string> sourceFilePaths;
+            std::error_code error;
+            llvm::sys::fs::recursive_directory_iterator it(module.getSourceDirectory(), error), end;
+            for (; it != end && !error; it.increment(error)) {
+                if (llvm::sys::path::extension(it->path()) == ".delta") {
+                    sourceFilePaths.push_back(it->path());
+                }
+            }
+            std::sort(sourceFilePaths.begin(), sourceFilePaths.end());
+            filePaths.insert(filePaths.end(), sourceFilePaths.begin(), sourceFilePaths.end());
+        }
+        for (auto& headerFile : module.getHeaderFiles()) {
+            filePaths.push_back(headerFile);
+        }
+    };
+
+    addFilePaths(module);
+    for (auto* importedModule : compiler.getImportedModules()) {
+        addFilePaths(*importedModule);
+    }
+    return filePaths;
+}
+
+/// Prints the requested reports about the compilation when the build finishes, on any return path.
+struct BuildReports {
+    bool timeReport;
+    std::string timeTraceFilePath;
+    bool statistics;
+    bool memoryStats;
+    const CompilerInstance& compiler;
+
+    ~BuildReports() {
+        if (timeReport) printTimeReport(llvm::errs());
+        if (!timeTraceFilePath.empty()) writeTimeTrace(timeTraceFilePath);
+        if (statistics) llvm::PrintStatisticsJSON(llvm::errs());
+        if (memoryStats) {
+            recordMemoryUsage("Type table", "Interned types", compiler.getTypeTable().getMemoryUsage());
+            printMemoryReport(llvm::errs());
+        }
+    }
+};
+
+std::string escapeForMakefile(llvm::StringRef filePath) {
+    std::string escaped;
+    for (char ch : filePath) {
+        if (ch == ' ' || ch == '#') escaped += '\\';
+        else if (ch == '$') escaped += '$';
+        escaped += ch;
+    }
+    return escaped;
+}
+
+/// Writes a Makefile-style dependency file stating that `target` depends on the given input files and on
+/// every Delta source file and C header read when importing modules into `module`.
+void writeDependencyFile(llvm::StringRef dependencyFilePath, llvm::StringRef target,
+                         llvm::ArrayRef<std::string> inputFiles, const Module& module,
+                         const CompilerInstance& compiler) {
+    std::error_code error;
+    llvm::raw_fd_ostream file(dependencyFilePath, error, llvm::sys::fs::F_Text);
+    if (error) printErrorAndExit("couldn't write '", dependencyFilePath, "': ", error.message());
+
+    file << escapeForMakefile(target) << ":";
+    llvm::StringSet<> writtenFilePaths;
+
+    for (auto& filePaths : { inputFiles.vec(), getInputFilePaths(module, compiler) }) {
+        for (auto& filePath : filePaths) {
+            if (!writtenFilePaths.insert(filePath).second) continue;
+            file << " \\\n  " << escapeForMakefile(filePath);
+        }
+    }
+
+    file << "\n";
+}
+
+/// Links the given object files, C sources, and other linker inputs into an executable. If `run` is true,
+/// runs the executable and returns its exit status, otherwise moves it to 'a.out'.
+int linkExecutable(llvm::ArrayRef<std::string> objectFiles, llvm::ArrayRef<std::string> cFiles,
+                   llvm::ArrayRef<std::string> linkerInputs, OptimizationLevel optimizationLevel,
+                   bool profileGenerate, bool run, const RunCache* runCache, const Module& module,
+                   const CompilerInstance& compiler) {
+    auto ccPath = findCCompiler();
+    auto cObjectFiles = map(cFiles, [&](const std::string& cFile) {
+        return compileCFile(ccPath, cFile, /* emitBitcode */ false, optimizationLevel);
+    });
+
+    llvm::SmallString<128> temporaryExecutablePath;
+    if (auto error = llvm::sys::fs::createUniqueFile("delta-%%%%%%%%.out", temporaryExecutablePath)) {
+        printErrorAndExit(error.message());
+    }
+
+    std::vector<const char*> ccArgs = { ccPath.c_str() };
+    for (auto& objectFile : objectFiles) {
+        ccArgs.push_back(objectFile.c_str());
+    }
+    for (auto& cObjectFile : cObjectFiles) {
+        ccArgs.push_back(cObjectFile.c_str());
+    }
+    for (auto& linkerInput : linkerInputs) {
+        ccArgs.push_back(linkerInput.c_str());
+    }
+    // The code of the modules imported from module interfaces.
+    auto libraryPaths = map(compiler.getImportedModules(), [](const Module* module) {
+        return module->getLibraryPath().str();
+    });
+    for (auto& libraryPath : libraryPaths) {
+        if (!libraryPath.empty()) ccArgs.push_back(libraryPath.c_str());
+    }
+    std::string profileRuntimeLibraryPath;
+    if (profileGenerate) {
+        profileRuntimeLibraryPath = getProfileRuntimeLibraryPath();
+        ccArgs.push_back(profileRuntimeLibraryPath.c_str());
+    }
+    ccArgs.push_back("-o");
+    ccArgs.push_back(temporaryExecutablePath.c_str());
+    ccArgs.push_back(nullptr);
+
+    int ccExitStatus;
+    {
+        TimeScope timeScope("Link", temporaryExecutablePath);
+        ccExitStatus = llvm::sys::ExecuteAndWait(ccArgs[0], ccArgs.data());
+    }
+    recordPhaseMemoryUsage("Link");
+    for (auto& cObjectFile : cObjectFiles) std::remove(cObjectFile.c_str());
+    if (ccExitStatus != 0) return ccExitStatus;
+
+    if (run) {
+        if (runCache) runCache->store(temporaryExecutablePath, getInputFilePaths(module, compiler));
+        int executableExitStatus = runExecutable(temporaryExecutablePath);
+        std::remove(temporaryExecutablePath.c_str());
+        return executableExitStatus;
+    }
+
+    if (auto error = llvm::sys::fs::rename(temporaryExecutablePath, "a.out")) {
+        printErrorAndExit(error.message());
+    }
+
+    return 0;
+}
+
+/// Returns the modules imported into `compiler` followed by `module`, ordered so that each module comes
+/// after the modules it imports according to SourceFile::getImportedModules(). Compiling the modules in
+/// this order starts with the leaf modules, such as the standard library.
+std::vector<const Module*> getModulesInDependencyOrder(const Module& module, const CompilerInstance& compiler) {
+    std::vector<const Module*> modules;
+    llvm::SmallPtrSet<const Module*, 16> visitedModules;
+
+    std::function<void(const Module&)> visit = [&](const Module& currentModule) {
+        if (!visitedModules.insert(&currentModule).second) return;
+        for (auto* importedModule : currentModule.getImportedModules()) {
+            visit(*importedModule);
+        }
+        modules.push_back(&currentModule);
+    };
+
+    for (auto* importedModule : compiler.getImportedModules()) {
+        visit(*importedModule);
+    }
+    visit(module);
+    return modules;
+}
+
+/// Returns the modules imported by `sourceFiles` of `module`, directly or through other modules, including
+/// the standard library, which every other module imports implicitly.
+std::vector<const Module*> getImportedModules(const Module& module, llvm::ArrayRef<const SourceFile*> sourceFiles,
+                                              const CompilerInstance& compiler) {
+    std::vector<const Module*> modules;
+    llvm::SmallPtrSet<const Module*, 16> visitedModules;
+    visitedModules.insert(&module);
+
+    std::function<void(const Module&)> visit = [&](const Module& currentModule) {
+        if (!visitedModules.insert(&currentModule).second) return;
+        modules.push_back(&currentModule);
+        for (auto* importedModule : currentModule.getImportedModules()) {
+            visit(*importedModule);
+        }
+    };
+
+    if (auto stdlibModule = compiler.getImportedModule("std")) visit(*stdlibModule);
+    for (auto* sourceFile : sourceFiles) {
+        for (auto& importedModule : sourceFile->getImportedModules()) {
+            visit(*importedModule);
+        }
+    }
+    return modules;
+}
+
+std::vector<const SourceFile*> getSourceFilePointers(const Module& module) {
+    return map(module.getSourceFiles(), [](const SourceFile& sourceFile) { return &sourceFile; });
+}
+
+/// Compiles each source file of `module` and each imported Delta module into a separate object file in
+/// `buildDirectory`, reusing the object files of the units that haven't changed since the previous build.
+/// The IR of each unit is generated on the calling thread and then compiled by `pipeline`.
+std::vector<std::string> compileUnitsIncrementally(const Module& module, CompilerInstance& compiler,
+                                                   llvm::StringRef buildDirectory,
+                                                   llvm::ArrayRef<llvm::StringRef> options,
+                                                   const TargetCPU& targetCPU, CodegenPipeline& pipeline,
+                                                   llvm::StringRef profileUseFile) {
+    IncrementalBuild build(buildDirectory, options);
+    if (!profileUseFile.empty()) build.addCommonDependency(profileUseFile);
+    std::vector<const Module*> importedModules;
+
+    for (auto* currentModule : getModulesInDependencyOrder(module, compiler)) {
+        for (auto& headerFile : currentModule->getHeaderFiles()) {
+            build.addModuleDependency(*currentModule, headerFile);
+        }
+        if (currentModule != &module && !currentModule->getSourceFiles().empty()) {
+            importedModules.push_back(currentModule);
+        }
+        if (!currentModule->getLibraryPath().empty()) {
+            // The module's code is linked from its prebuilt library, so only its interface affects the units.
+            for (auto& sourceFile : currentModule->getSourceFiles()) {
+                build.addModuleDependency(*currentModule, sourceFile.getFilePath());
+            }
+        } else if (currentModule == &module) {
+            for (auto& sourceFile : module.getSourceFiles()) {
+                build.addUnit(sourceFile.getFilePath(), module, { &sourceFile },
+                              getImportedModules(module, { &sourceFile }, compiler));
+            }
+        } else if (!currentModule->getSourceFiles().empty()) {
+            auto sourceFiles = getSourceFilePointers(*currentModule);
+            auto unitImportedModules = getImportedModules(*currentModule, sourceFiles, compiler);
+            build.addUnit("module:" + currentModule->getName().str(), *currentModule, std::move(sourceFiles),
+                          std::move(unitImportedModules));
+        }
+    }
+
+    std::vector<std::string> objectFiles;
+
+    for (auto& unit : build.getUnits()) {
+        objectFiles.push_back(build.getObjectFilePath(unit));
+
+        if (build.isUpToDate(unit)) {
+            build.markUpToDate(unit, /* reused */ true);
+            continue;
+        }
+
+        IRGenerator irGenerator(compiler);
+        irGenerator.setTargetCPU(targetCPU.name, targetCPU.features);
+        auto& irModule = irGenerator.compileUnit(*unit.module, unit.sourceFiles);
+        pipeline.addModule(irModule, objectFiles.back());
+        build.markUpToDate(unit, /* reused */ false);
+    }
+
+    pipeline.wait();
+    build.writeModuleInterfaces(importedModules, compiler);
+    build.writeState();
+    return objectFiles;
+}
+
+/// Compiles each Delta module into a temporary object file in dependency order, generating the IR of
+/// the next module while `pipeline` optimizes and emits the previous ones. Returns the object file paths.
+std::vector<std::string> compileModulesInPipeline(const Module& module, CompilerInstance& compiler,
+                                                  const TargetCPU& targetCPU, CodegenPipeline& pipeline) {
+    std::vector<std::string> objectFiles;
+
+    for (auto* currentModule : getModulesInDependencyOrder(module, compiler)) {
+        if (currentModule->getSourceFiles().empty() || !currentModule->getLibraryPath().empty()) continue;
+
+        llvm::SmallString<128> objectFilePath;
+        if (auto error = llvm::sys::fs::createTemporaryFile("delta", "o", objectFilePath)) {
+            printErrorAndExit(error.message());
+        }
+        objectFiles.push_back(objectFilePath.str());
+
+        IRGenerator irGenerator(compiler);
+        irGenerator.setTargetCPU(targetCPU.name, targetCPU.features);
+        auto& irModule = irGenerator.compileUnit(*currentModule, getSourceFilePointers(*currentModule));
+        pipeline.addModule(irModule, objectFiles.back());
+    }
+
+    pipeline.wait();
+    return objectFiles;
+}
+
+/// Removes all '-j<N>' options from `args` and returns the number of codegen threads specified by the
+/// last one, the number of hardware threads for a plain '-j', or zero if there are none.
+unsigned collectJobCount(std::vector<llvm::StringRef>& args) {
+    // Must be called after '-jit' has been removed from `args`.
+    auto values = collectStringOptionValues("-j", args);
+    if (values.empty()) return 0;
+    if (values.back().empty()) return std::max(std::thread::hardware_concurrency(), 1u);
+
+    unsigned long long jobCount;
+    if (llvm::getAsUnsignedInteger(values.back(), 10, jobCount) || jobCount == 0) {
+        printErrorAndExit("invalid job count '", values.back(), "'");
+    }
+    return unsigned(jobCount);
+}
+
 } // anonymous namespace
 
-int delta::buildPackage(llvm::StringRef packageRoot, std::vector<llvm::StringRef>& args, bool run) {
+int delta::buildPackage(llvm::StringRef packageRoot, std::vector<llvm::StringRef>& args, bool run,
+                        CompilerInstance& compiler) {
     PackageManifest manifest(packageRoot);
     fetchDependencies(packageRoot);
     auto sourceFiles = getSourceFiles(packageRoot);
 
+    // Build packages incrementally into a persistent build directory unless one is given explicitly.
+    std::string buildDirectoryOption = "-build-dir=" + (packageRoot + "/.delta-build").str();
+    bool hasBuildDirectoryOption = llvm::any_of(args, [](llvm::StringRef arg) {
+        return arg.startswith("-build-dir=");
+    });
+    if (!run && !hasBuildDirectoryOption) args.push_back(buildDirectoryOption);
+
     // TODO: Add support for library packages.
-    return buildExecutable(sourceFiles, &manifest, args, run);
+    return buildExecutable(sourceFiles, &manifest, args, run, compiler);
 }
 
 int delta::buildExecutable(llvm::ArrayRef<std::string> files, const PackageManifest* manifest,
-                           std::vector<llvm::StringRef>& args, bool run) {
+                           std::vector<llvm::StringRef>& args, bool run, CompilerInstance& compiler) {
+    bool noCache = checkFlag("-no-cache", args);
+    std::vector<llvm::StringRef> optionsForCache = args;
     bool parse = checkFlag("-parse", args);
     bool typecheck = checkFlag("-typecheck", args);
+    bool typecheckAll = checkFlag("-typecheck-all", args);
     bool compileOnly = checkFlag("-c", args);
     bool printAST = checkFlag("-print-ast", args);
     bool printIR = checkFlag("-print-ir", args);
+    bool printIRBeforeOptimization = checkFlag("-print-ir-before-opt", args);
     bool emitAssembly = checkFlag("-emit-assembly", args) || checkFlag("-S", args);
+    bool emitBitcode = checkFlag("-emit-bitcode", args);
     bool emitPositionIndependentCode = checkFlag("-fPIC", args);
+    bool linkTimeOptimization = checkFlag("-flto", args);
+    bool profileGenerate = checkFlag("-fprofile-generate", args);
+    auto profileUseFiles = collectStringOptionValues("-fprofile-use=", args);
+    bool fastCompile = checkFlag("-Ofast-compile", args);
+    bool useJIT = checkFlag("-jit", args);
+    bool streamFunctions = checkFlag("-stream-functions", args);
+    auto jobCount = collectJobCount(args);
+    auto optimizationLevel = collectOptimizationLevel(args);
+    if (fastCompile) optimizationLevel = { 0, 0 };
+    auto targetCPU = collectTargetCPU(args);
+    auto buildDirectories = collectStringOptionValues("-build-dir=", args);
+    bool writeDependencies = checkFlag("-MD", args);
+    auto dependencyFilePath = collectSeparateOptionValue("-MF", args);
+    bool timeReport = checkFlag("-ftime-report", args);
+    auto timeTraceFiles = collectStringOptionValues("-ftime-trace=", args);
+    bool printStatistics = checkFlag("-stats", args);
+    bool printMemoryStats = checkFlag("-print-memory-stats", args);
+    auto memoryBudgets = collectStringOptionValues("-memory-budget=", args);
     auto importSearchPaths = collectStringOptionValues("-I", args);
     importSearchPaths.push_back(DELTA_ROOT_DIR); // For development.
 
@@ -115,11 +657,69 @@ int delta::buildExecutable(llvm::ArrayRef<std::string> files, const PackageManif
         printErrorAndExit("no input files");
     }
 
+    if (useJIT && !run) {
+        printErrorAndExit("'-jit' can only be used with 'delta run'");
+    }
+
+    // The headers included by C inputs aren't known without running the C preprocessor, so changes to
+    // them couldn't invalidate a cached executable.
+    bool hasCInputs = llvm::any_of(files, [](llvm::StringRef filePath) {
+        return llvm::sys::path::extension(filePath) == ".c";
+    });
+
+    llvm::Optional<RunCache> runCache;
+    if (run && !noCache && !useJIT && !parse && !typecheck && !printAST && !printIR &&
+        !printIRBeforeOptimization && !compileOnly && !emitAssembly && !emitBitcode && !hasCInputs) {
+        // The profiles are part of the key like the input files, so that a regenerated profile isn't
+        // ignored.
+        std::vector<std::string> filesForCache = files;
+        filesForCache.insert(filesForCache.end(), profileUseFiles.begin(), profileUseFiles.end());
+        runCache.emplace(filesForCache, optionsForCache);
+        auto cachedExecutablePath = runCache->lookup();
+        if (!cachedExecutablePath.empty()) return runExecutable(cachedExecutablePath);
+    }
+
+    if (timeReport || !timeTraceFiles.empty()) enableTiming();
+    if (printStatistics) llvm::EnableStatistics(/* PrintOnExit */ false);
+    // A memory budget is checked at the phase boundaries recorded for the memory report, so it enables the
+    // recording even when the report isn't printed.
+    if (printMemoryStats || !memoryBudgets.empty()) {
+        unsigned long long budgetInMegabytes = 0;
+        if (!memoryBudgets.empty() && (llvm::getAsUnsignedInteger(memoryBudgets.back(), 10, budgetInMegabytes)
+                                       || budgetInMegabytes == 0)) {
+            printErrorAndExit("invalid memory budget '", memoryBudgets.back(), "', expected megabytes");
+        }
+        enableMemoryStats(budgetInMegabytes * 1024 * 1024);
+    }
+    BuildReports reports{ timeReport, timeTraceFiles.empty() ? "" : timeTraceFiles.back(), printStatistics,
+                          printMemoryStats, compiler };
+
     Module module("main");
     llvm::StringSet<> relativeImportSearchPaths;
+    std::vector<std::string> irFiles;
+    std::vector<std::string> cFiles;
+    std::vector<std::string> linkerInputs;
 
     for (llvm::StringRef filePath : files) {
-        ::parse(filePath, module);
+        auto extension = llvm::sys::path::extension(filePath);
+
+        if (extension == ".bc" || extension == ".ll") {
+            irFiles.push_back(filePath);
+            continue;
+        } else if (extension == ".c") {
+            cFiles.push_back(filePath);
+            continue;
+        } else if (extension == ".o" || extension == ".a" || extension == ".so") {
+            linkerInputs.push_back(filePath);
+            continue;
+        }
+
+        // Printing the AST requires all function bodies to be parsed up front.
+        if (streamFunctions && !printAST) {
+            parseSignatures(filePath, module, compiler);
+        } else {
+            ::parse(filePath, module, compiler);
+        }
 
         auto directoryPath = llvm::sys::path::parent_path(filePath);
         if (directoryPath.empty()) directoryPath = ".";
@@ -129,6 +729,7 @@ int delta::buildExecutable(llvm::ArrayRef<std::string> files, const PackageManif
     for (auto& keyValue : relativeImportSearchPaths) {
         importSearchPaths.push_back(keyValue.getKey());
     }
+    recordPhaseMemoryUsage("Parse");
 
     if (printAST) {
         std::cout << module;
@@ -137,85 +738,183 @@ int delta::buildExecutable(llvm::ArrayRef<std::string> files, const PackageManif
 
     if (parse) return 0;
 
-    for (auto& importedModule : module.getImportedModules()) {
-        typecheckModule(*importedModule, /* TODO: Pass the manifest of `*importedModule` here. */ nullptr,
-                        importSearchPaths, ::parse);
+    // Executables linked by the system linker use the prebuilt standard library if it's up to date, instead
+    // of compiling it from source. The other outputs contain the code of the standard library themselves.
+    // The prebuilt library is always optimized at -O2, whatever the -O level of the program, but the generic
+    // functions it instantiates are compiled with the program at the program's level.
+    bool linksExecutable = (run || module.getSymbolTable().contains("main")) && !compileOnly &&
+                           !emitAssembly && !emitBitcode && !linkTimeOptimization && !useJIT && !printIR &&
+                           !printIRBeforeOptimization;
+    bool usesDefaultCodegenOptions = !profileGenerate && profileUseFiles.empty() && targetCPU.name.empty() &&
+                                     targetCPU.features.empty();
+    if (linksExecutable && usesDefaultCodegenOptions) {
+        compiler.addModuleInterfaceDirectory(DELTA_PREBUILT_STDLIB_DIR);
     }
-    typecheckModule(module, manifest, importSearchPaths, ::parse);
+    // Incremental builds import the modules compiled by the previous build from their module interfaces.
+    if (linksExecutable && !buildDirectories.empty() && !streamFunctions && irFiles.empty()) {
+        auto interfaceDirectory = IncrementalBuild::findModuleInterfaces(buildDirectories.back(), optionsForCache,
+                                                                         compiler);
+        if (!interfaceDirectory.empty()) compiler.addModuleInterfaceDirectory(std::move(interfaceDirectory));
+    }
+
+    // Incremental builds compile all functions of the imported modules, as the next build may call more of
+    // them, and -stream-functions type-checks the calls in the program after the imported modules are compiled.
+    compiler.setTypecheckImportedBodiesOnDemand(!typecheckAll && buildDirectories.empty() && !streamFunctions);
+    typecheckModuleAndImports(module, manifest, importSearchPaths, compiler);
+    recordPhaseMemoryUsage("Type-check");
 
     bool treatAsLibrary = !module.getSymbolTable().contains("main") && !run;
-    if (treatAsLibrary) {
+    if (treatAsLibrary || emitBitcode) {
         compileOnly = true;
     }
 
-    if (typecheck) return 0;
-
-    IRGenerator irGenerator;
-    for (auto& module : getAllImportedModules()) {
-        irGenerator.compile(*module);
+    if (typecheck) {
+        if (streamFunctions) compileDeferredFunctionBodies(module, nullptr, nullptr, compiler);
+        return 0;
     }
-    auto& irModule = irGenerator.compile(module);
 
-    if (printIR) {
-        irModule.print(llvm::outs(), nullptr);
-        return 0;
+    // A single object, assembly or bitcode file is written, which can't include the object file inputs, and
+    // includes the C inputs only if they are compiled to bitcode for link-time optimization.
+    if ((compileOnly || emitAssembly) && !printIR && !printIRBeforeOptimization) {
+        if (!linkerInputs.empty()) {
+            printErrorAndExit("'", linkerInputs.front(), "' can only be used when linking an executable");
+        }
+        if (!cFiles.empty() && !linkTimeOptimization) {
+            printErrorAndExit("'", cFiles.front(), "' can only be used when linking an executable or with -flto");
+        }
     }
 
-    llvm::SmallString<128> temporaryOutputFilePath;
-    auto* outputFileExtension = emitAssembly ? "s" : "o";
-    if (auto error = llvm::sys::fs::createTemporaryFile("delta", outputFileExtension,
-                                                        temporaryOutputFilePath)) {
-        printErrorAndExit(error.message());
+    if (writeDependencies) {
+        auto* outputFilePath = emitBitcode ? "output.bc" : emitAssembly ? "output.s"
+                             : compileOnly ? "output.o" : "a.out";
+        if (dependencyFilePath.empty()) {
+            llvm::SmallString<128> path(outputFilePath);
+            llvm::sys::path::replace_extension(path, "d");
+            dependencyFilePath = path.str();
+        }
+        writeDependencyFile(dependencyFilePath, outputFilePath, files, module, compiler);
     }
 
-    auto fileType = emitAssembly ? llvm::TargetMachine::CGFT_AssemblyFile
-                                 : llvm::TargetMachine::CGFT_ObjectFile;
     auto relocModel = emitPositionIndependentCode ? llvm::Reloc::Model::PIC_
                                                   : llvm::Reloc::Model::Static;
-    emitMachineCode(irModule, temporaryOutputFilePath, fileType, relocModel);
+    // The raw profile is written by the instrumented executable on exit. It can be converted to the
+    // format expected by -fprofile-use with 'llvm-profdata merge'.
+    std::string profileGenerateFile = profileGenerate ? "default.profraw" : "";
+    std::string profileUseFile = profileUseFiles.empty() ? "" : profileUseFiles.back();
+
+    bool compilesModulesSeparately = !compileOnly && !emitAssembly && !linkTimeOptimization && !useJIT &&
+                                     !printIR && !printIRBeforeOptimization && !streamFunctions && irFiles.empty();
+
+    if (compilesModulesSeparately && !buildDirectories.empty()) {
+        CodegenPipeline pipeline(jobCount, targetCPU, relocModel, optimizationLevel, fastCompile,
+                                 profileGenerateFile, profileUseFile);
+        auto objectFiles = compileUnitsIncrementally(module, compiler, buildDirectories.back(), optionsForCache,
+                                                     targetCPU, pipeline, profileUseFile);
+        recordPhaseMemoryUsage("Incremental compilation");
+        return linkExecutable(objectFiles, cFiles, linkerInputs, optimizationLevel, profileGenerate, run,
+                              runCache.getPointer(), module, compiler);
+    }
 
-    if (compileOnly || emitAssembly) {
-        if (auto error = llvm::sys::fs::rename(temporaryOutputFilePath,
-                                               llvm::Twine("output.") + outputFileExtension)) {
-            printErrorAndExit(error.message());
-        }
+    if (compilesModulesSeparately && jobCount > 0) {
+        CodegenPipeline pipeline(jobCount, targetCPU, relocModel, optimizationLevel, fastCompile,
+                                 profileGenerateFile, profileUseFile);
+        auto objectFiles = compileModulesInPipeline(module, compiler, targetCPU, pipeline);
+        recordPhaseMemoryUsage("Pipelined compilation");
+        int exitStatus = linkExecutable(objectFiles, cFiles, linkerInputs, optimizationLevel, profileGenerate,
+                                        run, runCache.getPointer(), module, compiler);
+        for (auto& objectFile : objectFiles) std::remove(objectFile.c_str());
+        return exitStatus;
+    }
+
+    IRGenerator irGenerator(compiler);
+    irGenerator.setTargetCPU(targetCPU.name, targetCPU.features);
+    int64_t heapUsageBeforeIRGen = isMemoryStatsEnabled() ? getHeapUsage() : 0;
+    // Executables only need the code reachable from 'main', and from the C and IR inputs linked into them,
+    // which may call any function of the main module.
+    bool hasForeignInputs = !cFiles.empty() || !irFiles.empty() || !linkerInputs.empty();
+    bool compilesReachableCodeOnly = linksExecutable && !streamFunctions;
+    auto& irModule = compilesReachableCodeOnly ? irGenerator.compileExecutable(module, hasForeignInputs)
+                                               : generateIR(module, irGenerator, compiler);
+    auto targetMachine = createTargetMachine(irModule, targetCPU, relocModel, optimizationLevel,
+                                             fastCompile);
+    // The object file and library inputs may call any function of the main module, so the program is only
+    // optimized as a whole, i.e. with everything but 'main' internalized, when there are none.
+    bool isWholeProgram = linkTimeOptimization && !compileOnly && linkerInputs.empty();
+    Optimizer optimizer(irModule, *targetMachine, optimizationLevel, isWholeProgram, profileGenerateFile,
+                        profileUseFile);
+    if (streamFunctions) {
+        compileDeferredFunctionBodies(module, &irGenerator, printIRBeforeOptimization ? nullptr : &optimizer,
+                                      compiler);
+    }
+    int64_t heapUsageAfterIRGen = isMemoryStatsEnabled() ? getHeapUsage() : 0;
+    recordMemoryUsage("LLVM module", "Before optimization", heapUsageAfterIRGen - heapUsageBeforeIRGen);
+    recordPhaseMemoryUsage("IRGen");
+
+    if (printIRBeforeOptimization) {
+        irModule.print(llvm::outs(), nullptr);
         return 0;
     }
 
-    // Link the output.
+    if (linkTimeOptimization && !cFiles.empty()) {
+        // Compile the C inputs to LLVM bitcode so they can be optimized together with the Delta code.
+        auto ccPath = findBitcodeCompiler();
+        auto cBitcodeFiles = map(cFiles, [&](const std::string& cFile) {
+            return compileCFile(ccPath, cFile, /* emitBitcode */ true, optimizationLevel);
+        });
+        linkIRFiles(irModule, cBitcodeFiles);
+        for (auto& cBitcodeFile : cBitcodeFiles) std::remove(cBitcodeFile.c_str());
+        cFiles.clear();
+    }
+    linkIRFiles(irModule, irFiles);
 
-    llvm::ErrorOr<std::string> ccPath = llvm::sys::findProgramByName("cc");
-    if (!ccPath) {
-        printErrorAndExit("couldn't find C compiler");
+    optimizer.finish();
+    // Functions called only from the C and IR inputs would look unreachable, so keep everything with them.
+    if (((fastCompile && !compileOnly) || compilesReachableCodeOnly) && !hasForeignInputs) {
+        removeUnreachableGlobals(irModule);
+    }
+    if (isMemoryStatsEnabled()) {
+        // Includes the memory used by the linked IR inputs, which are part of the optimized module.
+        recordMemoryUsage("LLVM module", "After optimization", int64_t(getHeapUsage()) - heapUsageBeforeIRGen);
     }
+    recordPhaseMemoryUsage("Optimize");
 
-    llvm::SmallString<128> temporaryExecutablePath;
-    if (auto error = llvm::sys::fs::createUniqueFile("delta-%%%%%%%%.out", temporaryExecutablePath)) {
-        printErrorAndExit(error.message());
+    if (printIR) {
+        irModule.print(llvm::outs(), nullptr);
+        return 0;
     }
 
-    const char* ccArgs[] = {
-        ccPath->c_str(),
-        temporaryOutputFilePath.c_str(),
-        "-o",
-        temporaryExecutablePath.c_str(),
-        nullptr
-    };
+    if (emitBitcode) {
+        writeBitcode(irModule, "output.bc");
+        return 0;
+    }
 
-    int ccExitStatus = llvm::sys::ExecuteAndWait(ccArgs[0], ccArgs);
-    std::remove(temporaryOutputFilePath.c_str());
-    if (ccExitStatus != 0) return ccExitStatus;
+    if (useJIT) {
+        if (!cFiles.empty() || !linkerInputs.empty()) {
+            printErrorAndExit("'-jit' doesn't support C or object file inputs, use '-flto' to link C sources");
+        }
+        return runWithJIT(irGenerator.takeModule());
+    }
 
-    if (run) {
-        const char* executableArgs[] = { temporaryExecutablePath.c_str(), nullptr };
-        int executableExitStatus = llvm::sys::ExecuteAndWait(executableArgs[0], executableArgs);
-        std::remove(temporaryExecutablePath.c_str());
-        return executableExitStatus;
+    auto fileType = emitAssembly ? llvm::TargetMachine::CGFT_AssemblyFile
+                                 : llvm::TargetMachine::CGFT_ObjectFile;
+    llvm::SmallVector<char, 0> output;
+    emitMachineCode(irModule, *targetMachine, output, fileType);
+    recordPhaseMemoryUsage("Codegen");
+
+    if (compileOnly || emitAssembly) {
+        writeFile(emitAssembly ? "output.s" : "output.o", output);
+        return 0;
     }
 
-    if (auto error = llvm::sys::fs::rename(temporaryExecutablePath, "a.out")) {
+    // The C compiler links from files, so the object file has to be written to disk for linking.
+    llvm::SmallString<128> temporaryOutputFilePath;
+    if (auto error = llvm::sys::fs::createTemporaryFile("delta", "o", temporaryOutputFilePath)) {
         printErrorAndExit(error.message());
     }
+    writeFile(temporaryOutputFilePath, output);
 
-    return 0;
+    int exitStatus = linkExecutable({ temporaryOutputFilePath.str() }, cFiles, linkerInputs, optimizationLevel,
+                                    profileGenerate, run, runCache.getPointer(), module, compiler);
+    std::remove(temporaryOutputFilePath.c_str());
+    return exitStatus;
 }
@@ -10,12 +10,18 @@ class StringRef;
 
 namespace delta {
 
+class CompilerInstance;
 class PackageManifest;
 
 /// If `args` contains `flag`, removes it and returns true, otherwise returns false.
 bool checkFlag(llvm::StringRef flag, std::vector<llvm::StringRef>& args);
-int buildPackage(llvm::StringRef packageRoot, std::vector<llvm::StringRef>& args, bool run);
+/// Removes all arguments starting with `flagPrefix` from `args` and returns their values, i.e. the
+/// parts following the prefix.
+std::vector<std::string> collectStringOptionValues(llvm::StringRef flagPrefix,
+                                                   std::vector<llvm::StringRef>& args);
+int buildPackage(llvm::StringRef packageRoot, std::vector<llvm::StringRef>& args, bool run,
+                 CompilerInstance& compiler);
 int buildExecutable(llvm::ArrayRef<std::string> files, const PackageManifest* manifest,
-                    std::vector<llvm::StringRef>& args, bool run);
+                    std::vector<llvm::StringRef>& args, bool run, CompilerInstance& compiler);
 
 }
@@ -0,0 +1,225 @@
+#include <algorithm>
+#include <sstream>
+#include <llvm/ADT/ArrayRef.h>
+#include <llvm/ADT/STLExtras.h>
+#include <llvm/ADT/StringRef.h>
+#include <llvm/ADT/StringSet.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/MD5.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/Path.h>
+#include <llvm/Support/raw_ostream.h>
+#include "incremental-build.h"
+#include "../ast/ast-printer.h"
+#include "../ast/module.h"
+#include "../parser/module-interface.h"
+#include "../sema/typecheck.h"
+#include "../support/hash.h"
+#include "../support/utility.h"
+
+using namespace delta;
+
+namespace {
+
+const char stateFileName[] = "build-state";
+const char logFileName[] = "build.log";
+const char interfacesDirectoryName[] = "interfaces";
+/// Lists the modules in a module interface directory, along with the hashes of their sources.
+const char interfacesStampFileName[] = "modules";
+
+void writeFile(llvm::StringRef filePath, llvm::StringRef contents) {
+    std::error_code error;
+    llvm::raw_fd_ostream file(filePath, error, llvm::sys::fs::F_None);
+    if (error) printErrorAndExit("couldn't write '", filePath, "': ", error.message());
+    file << contents;
+}
+
+std::string hashOptions(llvm::ArrayRef<llvm::StringRef> options) {
+    llvm::MD5 hash;
+    hash.update(getCompilerIdentifier());
+    for (auto& option : options) {
+        hash.update(llvm::StringRef("", 1)); // Separator
+        hash.update(option);
+    }
+    return toHexString(hash);
+}
+
+/// Returns the directory of the interfaces of the modules compiled with the given options. The object files
+/// of the units are shared by all options, so each directory has copies of the ones its interfaces refer to.
+std::string getModuleInterfaceDirectory(llvm::StringRef buildDirectory, llvm::StringRef optionsHash) {
+    return (buildDirectory + "/" + interfacesDirectoryName + "/" + optionsHash).str();
+}
+
+} // anonymous namespace
+
+std::string IncrementalBuild::findModuleInterfaces(llvm::StringRef buildDirectory,
+                                                   llvm::ArrayRef<llvm::StringRef> options,
+                                                   CompilerInstance& compiler) {
+    auto interfaceDirectory = getModuleInterfaceDirectory(buildDirectory, hashOptions(options));
+    auto stamp = llvm::MemoryBuffer::getFile(interfaceDirectory + "/" + interfacesStampFileName);
+    if (!stamp) return "";
+
+    // Each line consists of the source hash of a module, the module name, and its source directory.
+    for (llvm::StringRef contents = (*stamp)->getBuffer(); !contents.empty();) {
+        auto line = readLine(contents);
+        auto sourceHash = readWord(line);
+        skipWhitespace(line);
+        readWord(line);
+        skipWhitespace(line);
+        if (hashModuleDirectory(line, compiler) != sourceHash) return "";
+    }
+
+    return interfaceDirectory;
+}
+
+IncrementalBuild::IncrementalBuild(llvm::StringRef buildDirectory, llvm::ArrayRef<llvm::StringRef> options)
+: buildDirectory(buildDirectory), optionsHash(hashOptions(options)) {
+    if (auto error = llvm::sys::fs::create_directories(buildDirectory)) {
+        printErrorAndExit("couldn't create build directory '", buildDirectory, "': ", error.message());
+    }
+
+    // Each line of the state file consists of the content hash and the dependency hash of a unit,
+    // followed by the unit's name.
+    if (auto state = llvm::MemoryBuffer::getFile(this->buildDirectory + "/" + stateFileName)) {
+        for (llvm::StringRef contents = (*state)->getBuffer(); !contents.empty();) {
+            auto line = readLine(contents);
+            auto contentHash = readWord(line);
+            skipWhitespace(line);
+            auto dependencyHash = readWord(line);
+            skipWhitespace(line);
+            previousState[line] = { contentHash, dependencyHash };
+        }
+    }
+}
+
+void IncrementalBuild::addUnit(llvm::StringRef name, const Module& module,
+                               std::vector<const SourceFile*> sourceFiles,
+                               std::vector<const Module*> importedModules) {
+    std::string contents = optionsHash;
+    std::ostringstream interface;
+
+    for (auto* sourceFile : sourceFiles) {
+        contents += "\n" + sourceFile->getFilePath().str() + " " + hashFile(sourceFile->getFilePath());
+        printInterface(interface, *sourceFile);
+    }
+
+    units.push_back({ name, &module, std::move(sourceFiles), hashString(contents), hashString(interface.str()),
+                      std::move(importedModules) });
+    dependencyHashes.clear();
+}
+
+void IncrementalBuild::addModuleDependency(const Module& module, llvm::StringRef filePath) {
+    moduleDependencies[&module].push_back(filePath);
+    dependencyHashes.clear();
+}
+
+void IncrementalBuild::addCommonDependency(llvm::StringRef filePath) {
+    commonDependencies.push_back(filePath);
+    dependencyHashes.clear();
+}
+
+const std::string& IncrementalBuild::getDependencyHash(const CompilationUnit& unit) {
+    auto& dependencyHash = dependencyHashes[unit.name];
+    if (!dependencyHash.empty()) return dependencyHash;
+
+    // The source files of a module see each other's declarations without importing each other.
+    auto dependsOn = [&](const Module* module) {
+        return module == unit.module || llvm::is_contained(unit.importedModules, module);
+    };
+
+    std::vector<const CompilationUnit*> sortedUnits;
+    for (auto& otherUnit : units) {
+        if (&otherUnit != &unit && dependsOn(otherUnit.module)) sortedUnits.push_back(&otherUnit);
+    }
+    std::sort(sortedUnits.begin(), sortedUnits.end(), [](const CompilationUnit* a, const CompilationUnit* b) {
+        return a->name < b->name;
+    });
+
+    std::string dependencies;
+    for (auto* otherUnit : sortedUnits) {
+        dependencies += otherUnit->interfaceHash + " " + otherUnit->name + "\n";
+    }
+    for (auto* module : unit.importedModules) {
+        for (auto& filePath : moduleDependencies.lookup(module)) {
+            dependencies += hashFile(filePath) + " " + filePath + "\n";
+        }
+    }
+    for (auto& filePath : commonDependencies) {
+        dependencies += hashFile(filePath) + " " + filePath + "\n";
+    }
+
+    dependencyHash = hashString(dependencies);
+    return dependencyHash;
+}
+
+std::string IncrementalBuild::getObjectFilePath(const CompilationUnit& unit) const {
+    return buildDirectory + "/" + hashString(unit.name) + ".o";
+}
+
+bool IncrementalBuild::isUpToDate(const CompilationUnit& unit) {
+    auto it = previousState.find(unit.name);
+    if (it == previousState.end()) return false;
+    if (it->second.first != unit.contentHash || it->second.second != getDependencyHash(unit)) return false;
+    return llvm::sys::fs::exists(getObjectFilePath(unit));
+}
+
+void IncrementalBuild::markUpToDate(const CompilationUnit& unit, bool reused) {
+    currentState[unit.name] = { unit.contentHash, getDependencyHash(unit) };
+    buildLog += (reused ? "reused " : "compiled ") + unit.name + "\n";
+}
+
+void IncrementalBuild::writeModuleInterfaces(llvm::ArrayRef<const Module*> importedModules,
+                                             CompilerInstance& compiler) const {
+    auto interfaceDirectory = getModuleInterfaceDirectory(buildDirectory, optionsHash);
+    if (auto error = llvm::sys::fs::create_directories(interfaceDirectory)) {
+        printErrorAndExit("couldn't create '", interfaceDirectory, "': ", error.message());
+    }
+    llvm::StringSet<> moduleNames;
+    std::string stamp;
+
+    for (auto* module : importedModules) {
+        auto moduleInterfaceDirectory = interfaceDirectory + "/" + module->getName().str();
+
+        if (module->getLibraryPath().empty()) {
+            auto unit = llvm::find_if(units, [&](const CompilationUnit& unit) { return unit.module == module; });
+            ASSERT(unit != units.end());
+            auto libraryFileName = module->getName().str() + ".o";
+            auto libraryPath = moduleInterfaceDirectory + "/" + libraryFileName;
+            if (auto error = llvm::sys::fs::copy_file(getObjectFilePath(*unit), libraryPath)) {
+                printErrorAndExit("couldn't write '", libraryPath, "': ", error.message());
+            }
+            writeModuleInterfaceDirectory(*module, moduleInterfaceDirectory, libraryFileName, compiler);
+        } else if (!module->getLibraryPath().startswith(moduleInterfaceDirectory + "/")) {
+            continue; // Imported from a module interface elsewhere, e.g. the prebuilt standard library.
+        }
+
+        moduleNames.insert(module->getName());
+        stamp += hashModuleDirectory(module->getSourceDirectory(), compiler) + " " + module->getName().str() +
+                 " " + module->getSourceDirectory().str() + "\n";
+    }
+
+    // Remove the interfaces of the modules that are no longer imported, as they may have been compiled
+    // against a different version of the modules listed in the stamp.
+    std::error_code error;
+    for (llvm::sys::fs::directory_iterator it(interfaceDirectory, error), end; it != end && !error;
+         it.increment(error)) {
+        auto name = llvm::sys::path::filename(it->path());
+        if (name != interfacesStampFileName && !moduleNames.count(name)) {
+            llvm::sys::fs::remove_directories(it->path());
+        }
+    }
+
+    writeFile(interfaceDirectory + "/" + interfacesStampFileName, stamp);
+}
+
+void IncrementalBuild::writeState() const {
+    std::string state;
+    for (auto& unit : units) {
+        auto it = currentState.find(unit.name);
+        if (it == currentState.end()) continue;
+        state += it->second.first + " " + it->second.second + " " + unit.name + "\n";
+    }
+
+    writeFile(buildDirectory + "/" + stateFileName, state);
+    writeFile(buildDirectory + "/" + logFileName, buildLog);
+}
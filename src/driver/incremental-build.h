@@ -0,0 +1,82 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <llvm/ADT/DenseMap.h>
+#include <llvm/ADT/StringMap.h>
+
+namespace llvm {
+template<typename T> class ArrayRef;
+class StringRef;
+}
+
+namespace delta {
+
+class CompilerInstance;
+class Module;
+class SourceFile;
+
+/// A part of the program that is compiled into its own object file: either a single source file of the
+/// module being built, or a whole imported module.
+struct CompilationUnit {
+    std::string name;
+    const Module* module;
+    std::vector<const SourceFile*> sourceFiles;
+    std::string contentHash;
+    std::string interfaceHash;
+    /// The modules imported by the unit's source files, directly or through other modules.
+    std::vector<const Module*> importedModules;
+};
+
+/// Tracks the compilation units of an incremental build in a persistent build directory. A unit is
+/// recompiled if its contents or the compiler options changed, or if any of its dependencies changed since
+/// the unit's object file was built: the interfaces of the other units of its module, the interfaces of the
+/// units of the modules it imports, and the files those modules were imported from, e.g. C headers.
+/// Otherwise the previous object file is reused.
+///
+/// The imported modules compiled by a build are also written as module interfaces, so that the next build
+/// with the same options imports them from their interfaces instead of parsing and type-checking all of
+/// their function bodies, and links their previous object files.
+class IncrementalBuild {
+public:
+    IncrementalBuild(llvm::StringRef buildDirectory, llvm::ArrayRef<llvm::StringRef> options);
+    /// Returns the directory containing the module interfaces written by the previous build with the given
+    /// options, or an empty string if there are none, or if the sources of any module in it have changed
+    /// since, in which case the other interfaces may be out of date as well.
+    static std::string findModuleInterfaces(llvm::StringRef buildDirectory,
+                                            llvm::ArrayRef<llvm::StringRef> options, CompilerInstance& compiler);
+    void addUnit(llvm::StringRef name, const Module& module, std::vector<const SourceFile*> sourceFiles,
+                 std::vector<const Module*> importedModules);
+    /// Adds a file that the units importing `module` depend on, e.g. a C header or a module interface.
+    void addModuleDependency(const Module& module, llvm::StringRef filePath);
+    /// Adds a file that all units depend on, e.g. a profile used for optimization.
+    void addCommonDependency(llvm::StringRef filePath);
+    const std::vector<CompilationUnit>& getUnits() const { return units; }
+    std::string getObjectFilePath(const CompilationUnit& unit) const;
+    bool isUpToDate(const CompilationUnit& unit);
+    /// Records the state of the given unit after it has been (re)compiled or reused.
+    void markUpToDate(const CompilationUnit& unit, bool reused);
+    /// Writes the module interfaces of the given imported modules that were compiled from their sources in
+    /// this build, along with copies of their object files, and records them for findModuleInterfaces().
+    /// Must be called after the object files have been written.
+    void writeModuleInterfaces(llvm::ArrayRef<const Module*> importedModules, CompilerInstance& compiler) const;
+    /// Writes the recorded unit states and the build log listing the reused and recompiled units.
+    void writeState() const;
+
+private:
+    const std::string& getDependencyHash(const CompilationUnit& unit);
+
+private:
+    std::string buildDirectory;
+    std::string optionsHash;
+    std::vector<CompilationUnit> units;
+    llvm::DenseMap<const Module*, std::vector<std::string>> moduleDependencies;
+    std::vector<std::string> commonDependencies;
+    llvm::StringMap<std::string> dependencyHashes;
+    /// The content and dependency hashes of each unit, as of the previous build.
+    llvm::StringMap<std::pair<std::string, std::string>> previousState;
+    llvm::StringMap<std::pair<std::string, std::string>> currentState;
+    std::string buildLog;
+};
+
+}
@@ -0,0 +1,66 @@
+#include "jit.h"
+#include <mutex>
+#include <llvm/ExecutionEngine/ExecutionEngine.h>
+#include <llvm/ExecutionEngine/RTDyldMemoryManager.h>
+#include <llvm/ExecutionEngine/SectionMemoryManager.h>
+#include <llvm/ExecutionEngine/Orc/LambdaResolver.h>
+#include <llvm/IR/Mangler.h>
+#include <llvm/IR/Module.h>
+#include <llvm/Support/DynamicLibrary.h>
+#include <llvm/Support/raw_ostream.h>
+#include <llvm/Support/TargetSelect.h>
+
+using namespace delta;
+
+namespace {
+
+llvm::TargetMachine* createHostTargetMachine() {
+    static std::once_flag targetInitialized;
+    std::call_once(targetInitialized, [] {
+        llvm::InitializeNativeTarget();
+        llvm::InitializeNativeTargetAsmPrinter();
+        llvm::InitializeNativeTargetAsmParser();
+    });
+    return llvm::EngineBuilder().selectTarget();
+}
+
+} // anonymous namespace
+
+JIT::JIT()
+: targetMachine(createHostTargetMachine()), dataLayout(targetMachine->createDataLayout()),
+  objectLayer([]() { return std::make_shared<llvm::SectionMemoryManager>(); }),
+  compileLayer(objectLayer, llvm::orc::SimpleCompiler(*targetMachine)) {
+    // Make the symbols of the host process, including the C standard library, available to JIT'd code.
+    llvm::sys::DynamicLibrary::LoadLibraryPermanently(nullptr);
+}
+
+JIT::ModuleHandle JIT::addModule(std::unique_ptr<llvm::Module> module) {
+    auto resolver = llvm::orc::createLambdaResolver(
+        [this](const std::string& name) {
+            if (auto symbol = compileLayer.findSymbol(name, false)) return symbol;
+            return llvm::JITSymbol(nullptr);
+        },
+        [](const std::string& name) {
+            if (auto address = llvm::RTDyldMemoryManager::getSymbolAddressInProcess(name)) {
+                return llvm::JITSymbol(address, llvm::JITSymbolFlags::Exported);
+            }
+            return llvm::JITSymbol(nullptr);
+        });
+
+    module->setDataLayout(dataLayout);
+    return llvm::cantFail(compileLayer.addModule(std::move(module), std::move(resolver)));
+}
+
+void JIT::removeModule(ModuleHandle handle) {
+    llvm::cantFail(compileLayer.removeModule(handle));
+}
+
+llvm::JITTargetAddress JIT::getSymbolAddress(llvm::StringRef name) {
+    std::string mangledName;
+    llvm::raw_string_ostream mangledNameStream(mangledName);
+    llvm::Mangler::getNameWithPrefix(mangledNameStream, name, dataLayout);
+
+    auto symbol = compileLayer.findSymbol(mangledNameStream.str(), true);
+    if (!symbol) return 0;
+    return llvm::cantFail(symbol.getAddress());
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <llvm/ExecutionEngine/JITSymbol.h>
+#include <llvm/ExecutionEngine/Orc/CompileUtils.h>
+#include <llvm/ExecutionEngine/Orc/IRCompileLayer.h>
+#include <llvm/ExecutionEngine/Orc/RTDyldObjectLinkingLayer.h>
+#include <llvm/IR/DataLayout.h>
+#include <llvm/Target/TargetMachine.h>
+
+namespace llvm {
+class Module;
+class StringRef;
+}
+
+namespace delta {
+
+/// In-process JIT compiler built on the LLVM ORC layers. Symbols that are not defined by the added
+/// modules, e.g. libc functions, are resolved from the host process.
+class JIT {
+public:
+    using ModuleHandle = llvm::orc::IRCompileLayer<llvm::orc::RTDyldObjectLinkingLayer,
+                                                   llvm::orc::SimpleCompiler>::ModuleHandleT;
+
+    JIT();
+    llvm::TargetMachine& getTargetMachine() { return *targetMachine; }
+    const llvm::DataLayout& getDataLayout() const { return dataLayout; }
+    /// Compiles the given module to native code and makes its symbols available for lookup.
+    ModuleHandle addModule(std::unique_ptr<llvm::Module> module);
+    void removeModule(ModuleHandle handle);
+    /// Returns the address of the given symbol, or 0 if none of the added modules define it.
+    llvm::JITTargetAddress getSymbolAddress(llvm::StringRef name);
+
+private:
+    std::unique_ptr<llvm::TargetMachine> targetMachine;
+    const llvm::DataLayout dataLayout;
+    llvm::orc::RTDyldObjectLinkingLayer objectLayer;
+    llvm::orc::IRCompileLayer<llvm::orc::RTDyldObjectLinkingLayer, llvm::orc::SimpleCompiler> compileLayer;
+};
+
+}
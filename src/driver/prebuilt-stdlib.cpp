@@ -0,0 +1,94 @@
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <system_error>
+#include <vector>
+#include <llvm/ADT/SmallString.h>
+#include <llvm/ADT/SmallVector.h>
+#include <llvm/ADT/StringRef.h>
+#include <llvm/IR/Module.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/Path.h>
+#include <llvm/Support/raw_ostream.h>
+#include "prebuilt-stdlib.h"
+#include "compile.h"
+#include "../ast/compiler-instance.h"
+#include "../ast/module.h"
+#include "../irgen/irgen.h"
+#include "../parser/module-interface.h"
+#include "../parser/parse.h"
+#include "../sema/typecheck.h"
+#include "../support/utility.h"
+
+using namespace delta;
+
+namespace {
+
+const char libraryFileName[] = "libdelta_std.a";
+
+void writeFile(llvm::StringRef filePath, llvm::StringRef contents) {
+    std::error_code error;
+    llvm::raw_fd_ostream file(filePath, error, llvm::sys::fs::F_None);
+    if (error) printErrorAndExit("couldn't write '", filePath, "': ", error.message());
+    file << contents;
+}
+
+} // anonymous namespace
+
+int delta::buildPrebuiltStdlib(llvm::StringRef outputDirectory, CompilerInstance& compiler) {
+    llvm::SmallString<128> stdlibDirectory(outputDirectory);
+    llvm::sys::path::append(stdlibDirectory, "std");
+    if (auto error = llvm::sys::fs::create_directories(stdlibDirectory)) {
+        printErrorAndExit("couldn't create '", stdlibDirectory, "': ", error.message());
+    }
+
+    // Register the module before type-checking it, so that it doesn't import the standard library again.
+    auto module = std::make_shared<Module>("std");
+    compiler.addImportedModule(module);
+
+    llvm::SmallString<128> sourceDirectory(DELTA_ROOT_DIR);
+    llvm::sys::path::append(sourceDirectory, "stdlib");
+    module->setSourceDirectory(sourceDirectory);
+
+    // Parsed in a deterministic order, so that the prebuilt library is reproducible.
+    std::vector<std::string> sourceFilePaths;
+    std::error_code error;
+    llvm::sys::fs::recursive_directory_iterator it(sourceDirectory, error), end;
+    for (; it != end && !error; it.increment(error)) {
+        if (llvm::sys::path::extension(it->path()) == ".delta") {
+            sourceFilePaths.push_back(it->path());
+        }
+    }
+    if (error) printErrorAndExit("couldn't read '", sourceDirectory, "': ", error.message());
+
+    std::sort(sourceFilePaths.begin(), sourceFilePaths.end());
+    for (auto& sourceFilePath : sourceFilePaths) {
+        parseSignatures(sourceFilePath, *module, compiler);
+    }
+
+    std::vector<std::string> importSearchPaths = { DELTA_ROOT_DIR };
+    typecheckModule(*module, nullptr, importSearchPaths, parse, compiler);
+
+    // Compiled as a separate unit, so that the generic instantiations used by the standard library get
+    // linkonce_odr linkage and don't clash with the same instantiations in the importing programs.
+    IRGenerator irGenerator(compiler);
+    auto sourceFiles = map(module->getSourceFiles(), [](const SourceFile& sourceFile) { return &sourceFile; });
+    auto& irModule = irGenerator.compileUnit(*module, sourceFiles);
+    compileDeferredFunctionBodies(*module, &irGenerator, nullptr, compiler);
+
+    // Position-independent code can be linked into both position-dependent and -independent executables.
+    // The library is linked into programs built at any -O level, so it's optimized at -O2 for all of them.
+    OptimizationLevel optimizationLevel = { 2, 0 };
+    auto targetMachine = createTargetMachine(irModule, TargetCPU(), llvm::Reloc::Model::PIC_, optimizationLevel,
+                                             /* fastCompile */ false);
+    optimizeModule(irModule, *targetMachine, optimizationLevel, /* isWholeProgram */ false, "", "");
+    llvm::SmallVector<char, 0> objectFile;
+    emitMachineCode(irModule, *targetMachine, objectFile, llvm::TargetMachine::CGFT_ObjectFile);
+
+    llvm::SmallString<128> objectFilePath(stdlibDirectory);
+    llvm::sys::path::append(objectFilePath, "std.o");
+    writeFile(objectFilePath, llvm::StringRef(objectFile.data(), objectFile.size()));
+
+    writeModuleInterfaceDirectory(*module, stdlibDirectory, libraryFileName, compiler);
+    return 0;
+}
@@ -0,0 +1,16 @@
+#pragma once
+
+namespace llvm {
+class StringRef;
+}
+
+namespace delta {
+
+class CompilerInstance;
+
+/// Writes the binary module interfaces of the standard library and an object file with the code of its
+/// non-generic functions into the 'std' subdirectory of `outputDirectory`, to be archived into
+/// libdelta_std.a by the build system. Generic functions are instantiated by the importing programs.
+int buildPrebuiltStdlib(llvm::StringRef outputDirectory, CompilerInstance& compiler);
+
+}
@@ -1,14 +1,16 @@
 #include "repl.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <llvm/ADT/STLExtras.h>
 #include <llvm/Support/raw_ostream.h>
 #include <llvm/Support/Format.h>
 #include <llvm/Support/MemoryBuffer.h>
-#include <llvm/Support/TargetSelect.h>
 #include <llvm/LineEditor/LineEditor.h>
 #include <llvm/IR/Function.h>
 #include <llvm/IR/Verifier.h>
-#include <llvm/ExecutionEngine/ExecutionEngine.h>
-#include <llvm/ExecutionEngine/GenericValue.h>
-#include <llvm/ExecutionEngine/Interpreter.h>
+#include "jit.h"
+#include "../ast/compiler-instance.h"
 #include "../ast/expr.h"
 #include "../ast/module.h"
 #include "../irgen/irgen.h"
@@ -20,17 +22,85 @@ using namespace delta;
 
 namespace {
 
-void evaluate(llvm::StringRef line) {
-    Module module("main");
+/// State that is kept across REPL lines: the AST module and symbol table containing the declarations
+/// entered so far, the compiler instance holding the type-checked standard library, and the code
+/// already compiled by the JIT.
+class ReplSession {
+public:
+    ReplSession();
+    void evaluate(llvm::StringRef line);
+
+private:
+    void evaluateDecls(llvm::StringRef line);
+    void evaluateExpr(llvm::StringRef line);
+    SourceFile& getSourceFile() { return module.getSourceFiles().front(); }
+
+    CompilerInstance compiler;
+    JIT jit;
+    Module module;
+    IRGenerator irGenerator;
+    std::vector<std::string> importSearchPaths;
+    int evaluatedExprCount;
+};
+
+bool isDeclStart(llvm::StringRef line) {
+    skipWhitespace(line);
+    auto word = readWord(line);
+    return word == "func" || word == "extern" || word == "struct" || word == "class" || word == "interface"
+           || word == "let" || word == "var" || word == "import";
+}
+
+ReplSession::ReplSession()
+: module("main"), irGenerator(compiler), importSearchPaths({ DELTA_ROOT_DIR, "." }), evaluatedExprCount(0) {
     module.addSourceFile(SourceFile(llvm::StringRef()));
+    typecheckModule(module, /* manifest */ nullptr, importSearchPaths, parse, compiler);
+}
 
-    IRGenerator irGenerator;
-    irGenerator.setTypeChecker(TypeChecker(&module, &module.getSourceFiles().front()));
+void ReplSession::evaluate(llvm::StringRef line) {
+    if (isDeclStart(line)) {
+        evaluateDecls(line);
+    } else {
+        evaluateExpr(line);
+    }
+}
+
+void ReplSession::evaluateDecls(llvm::StringRef line) {
+    std::vector<Decl*> decls;
+    // The parser registers each declaration as soon as it has been parsed, so if the line turns out to be
+    // invalid, its declarations are removed again to allow them to be redefined on a later line.
+    auto declCount = getSourceFile().getTopLevelDecls().size();
+    auto symbolTable = module.getSymbolTable();
+
+    try {
+        decls = parseTopLevelDecls(llvm::MemoryBuffer::getMemBufferCopy(line, ""), module, getSourceFile(),
+                                   compiler);
+        TypeChecker typeChecker(&module, &getSourceFile(), compiler);
+
+        for (Decl* decl : decls) {
+            if (auto* varDecl = llvm::dyn_cast<VarDecl>(decl)) {
+                typeChecker.typecheckVarDecl(*varDecl, /* isGlobal */ true);
+            } else {
+                typeChecker.typecheckTopLevelDecl(*decl, /* manifest */ nullptr, importSearchPaths, parse);
+            }
+        }
+
+        typeChecker.postProcess();
+    } catch (const CompileError& error) {
+        error.print();
+        module.getSymbolTable() = std::move(symbolTable);
+        getSourceFile().removeDeclsAfter(declCount);
+        return;
+    }
 
+    irGenerator.compile(module, getSourceFile(), decls);
+    jit.addModule(irGenerator.takeModule());
+}
+
+void ReplSession::evaluateExpr(llvm::StringRef line) {
     std::unique_ptr<Expr> expr;
     try {
-        expr = parseExpr(llvm::MemoryBuffer::getMemBuffer(line, "", false), module);
-        irGenerator.getTypeChecker().typecheckExpr(*expr);
+        expr = parseExpr(llvm::MemoryBuffer::getMemBufferCopy(line, ""), module, compiler);
+        TypeChecker(&module, &getSourceFile(), compiler).typecheckExpr(*expr);
     } catch (const CompileError& error) {
         llvm::StringRef trimmed = line.ltrim();
         bool isComment = trimmed.size() >= 2 && trimmed[0] == '/' && trimmed[1] == '/';
@@ -38,40 +108,64 @@ void evaluate(llvm::StringRef line) {
         return;
     }
 
-    llvm::InitializeNativeTarget();
-    auto irModule = llvm::make_unique<llvm::Module>("deltajit", irgen::getContext());
-    auto& irModuleRef = *irModule;
-
-    std::string error;
-    llvm::ExecutionEngine* engine = llvm::EngineBuilder(std::move(irModule)).setErrorStr(&error).create();
-    if (!error.empty()) llvm::outs() << error << '\n';
+    Type type = expr->getType();
+    if (!type.isInteger() && !type.isFloatingPoint() && !type.isBool()) {
+        printErrorAndExit("unsupported result type");
+    }
 
-    llvm::FunctionType* functionType = llvm::FunctionType::get(irGenerator.toIR(expr->getType()), {}, false);
+    // Widen the result to a 64-bit integer or a double, so that only two native function types
+    // are needed to call the compiled expression.
+    irGenerator.setTypeChecker(TypeChecker(&module, &getSourceFile(), compiler));
+    auto& irModule = irGenerator.getIRModule();
+    auto& ctx = compiler.getLLVMContext();
+    llvm::Type* resultType = type.isFloatingPoint() ? llvm::Type::getDoubleTy(ctx)
+                                                    : llvm::Type::getInt64Ty(ctx);
+    llvm::FunctionType* functionType = llvm::FunctionType::get(resultType, {}, false);
+    auto functionName = "__anon_expr" + std::to_string(evaluatedExprCount++);
     llvm::Function* function = llvm::Function::Create(functionType, llvm::Function::ExternalLinkage,
-                                                      "__anon_expr", &irModuleRef);
-    irGenerator.getBuilder().SetInsertPoint(llvm::BasicBlock::Create(irgen::getContext(), "", function));
-    irGenerator.getBuilder().CreateRet(irGenerator.codegenExpr(*expr));
-    ASSERT(!llvm::verifyModule(irModuleRef, &llvm::errs()));
-
-    llvm::GenericValue result = engine->runFunction(function, {});
-
-    if (expr->getType().isInteger()) {
-        result.IntVal.print(llvm::outs(), expr->getType().isSigned());
-    } else if (expr->getType().isFloatingPoint()) {
-        llvm::outs() << result.DoubleVal;
-    } else if (expr->getType().isBool()) {
-        llvm::outs() << (result.IntVal != 0 ? "true" : "false");
+                                                      functionName, &irModule);
+    irGenerator.getBuilder().SetInsertPoint(llvm::BasicBlock::Create(ctx, "", function));
+    llvm::Value* result = irGenerator.codegenExpr(*expr);
+    if (type.isFloatingPoint()) {
+        result = irGenerator.getBuilder().CreateFPCast(result, resultType);
     } else {
-        printErrorAndExit("unsupported result type");
+        result = irGenerator.getBuilder().CreateIntCast(result, resultType, type.isSigned());
+    }
+    irGenerator.getBuilder().CreateRet(result);
+    irGenerator.codegenFunctionInstantiations(module);
+    ASSERT(!llvm::verifyModule(irModule, &llvm::errs()));
+
+    // Keep the module in the JIT if the expression caused e.g. stdlib functions to be compiled for
+    // the first time, so that later lines can reuse them.
+    bool definesOnlyExprFunction = llvm::all_of(irModule, [&](const llvm::Function& f) {
+        return f.isDeclaration() || &f == function;
+    });
+    auto moduleHandle = jit.addModule(irGenerator.takeModule());
+    auto address = static_cast<intptr_t>(jit.getSymbolAddress(functionName));
+
+    if (type.isFloatingPoint()) {
+        llvm::outs() << reinterpret_cast<double (*)()>(address)();
+    } else {
+        int64_t value = reinterpret_cast<int64_t (*)()>(address)();
+
+        if (type.isBool()) {
+            llvm::outs() << (value != 0 ? "true" : "false");
+        } else if (type.isSigned()) {
+            llvm::outs() << value;
+        } else {
+            llvm::outs() << static_cast<uint64_t>(value);
+        }
     }
 
     llvm::outs() << '\n';
+    if (definesOnlyExprFunction) jit.removeModule(moduleHandle);
 }
 
 }
 
 int delta::replMain() {
     llvm::LineEditor editor("", llvm::LineEditor::getDefaultHistoryPath("delta-repl"));
+    ReplSession session;
     int lineNumber = 0;
     std::string prompt;
 
@@ -83,7 +177,7 @@ int delta::replMain() {
         if (!line) break;
 
         editor.saveHistory();
-        evaluate(*line);
+        session.evaluate(*line);
         lineNumber++;
         prompt.clear();
     }
@@ -0,0 +1,176 @@
+#include <algorithm>
+#include <cstdio>
+#include <ctime>
+#include <system_error>
+#include <vector>
+#include <llvm/ADT/ArrayRef.h>
+#include <llvm/ADT/SmallString.h>
+#include <llvm/ADT/StringRef.h>
+#include <llvm/Support/Chrono.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/MD5.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/Path.h>
+#include <llvm/Support/Process.h>
+#include <llvm/Support/raw_ostream.h>
+#include "run-cache.h"
+#include "../support/hash.h"
+#include "../support/utility.h"
+
+using namespace delta;
+
+namespace {
+
+/// The total size of the cached executables above which the least recently used ones are evicted.
+const uint64_t maxCacheSize = 512 * 1024 * 1024;
+
+/// Writes `contents` to a new file in `directoryPath` and renames it to `filePath`, so that readers
+/// never see a partially written file even if multiple compilers populate the cache concurrently.
+bool writeFileAtomically(llvm::StringRef directoryPath, llvm::StringRef filePath,
+                         llvm::StringRef contents, unsigned mode) {
+    int fileDescriptor;
+    llvm::SmallString<128> temporaryFilePath;
+    if (llvm::sys::fs::createUniqueFile(directoryPath + "/tmp-%%%%%%%%", fileDescriptor,
+                                        temporaryFilePath, mode)) {
+        return false;
+    }
+
+    {
+        llvm::raw_fd_ostream file(fileDescriptor, /* shouldClose */ true);
+        file << contents;
+        file.close();
+        if (file.has_error()) {
+            file.clear_error();
+            std::remove(temporaryFilePath.c_str());
+            return false;
+        }
+    }
+
+    if (llvm::sys::fs::rename(temporaryFilePath, filePath)) {
+        std::remove(temporaryFilePath.c_str());
+        return false;
+    }
+    return true;
+}
+
+/// Updates the modification time of the given file, which is used as its last use time for eviction.
+void touch(llvm::StringRef filePath) {
+    int fileDescriptor;
+    if (llvm::sys::fs::openFileForWrite(filePath, fileDescriptor, llvm::sys::fs::F_Append)) return;
+    llvm::sys::fs::setLastModificationAndAccessTime(fileDescriptor, llvm::sys::toTimePoint(std::time(nullptr)));
+    llvm::sys::Process::SafelyCloseFileDescriptor(fileDescriptor);
+}
+
+} // anonymous namespace
+
+RunCache::RunCache(llvm::ArrayRef<std::string> inputFiles, llvm::ArrayRef<llvm::StringRef> args) {
+    llvm::SmallString<128> path;
+    if (llvm::sys::path::user_cache_directory(path, "delta", "run")) {
+        directoryPath = path.str();
+    }
+
+    llvm::MD5 hash;
+    auto addToHash = [&](llvm::StringRef string) {
+        hash.update(string);
+        hash.update(llvm::StringRef("", 1)); // Separator
+    };
+
+    addToHash(getCompilerIdentifier());
+
+    // Relative imports are resolved from the working directory.
+    llvm::SmallString<128> currentPath;
+    if (!llvm::sys::fs::current_path(currentPath)) addToHash(currentPath);
+
+    for (auto& arg : args) {
+        addToHash(arg);
+    }
+
+    for (auto& inputFile : inputFiles) {
+        addToHash(inputFile);
+        addToHash(hashFile(inputFile));
+    }
+
+    key = toHexString(hash);
+}
+
+std::string RunCache::getEntryPath(llvm::StringRef extension) const {
+    return directoryPath + "/" + key + extension.str();
+}
+
+std::string RunCache::lookup() const {
+    if (directoryPath.empty()) return "";
+
+    auto executablePath = getEntryPath(".out");
+    auto dependencies = llvm::MemoryBuffer::getFile(getEntryPath(".deps"));
+    if (!dependencies || !llvm::sys::fs::exists(executablePath)) return "";
+
+    // Each line consists of the hash of a dependency's contents followed by its path.
+    for (llvm::StringRef contents = (*dependencies)->getBuffer(); !contents.empty();) {
+        auto line = readLine(contents);
+        auto expectedHash = readWord(line);
+        skipWhitespace(line);
+        if (hashFile(line) != expectedHash) return "";
+    }
+
+    touch(executablePath);
+    return executablePath;
+}
+
+void RunCache::store(llvm::StringRef executablePath, llvm::ArrayRef<std::string> dependencies) const {
+    if (directoryPath.empty() || llvm::sys::fs::create_directories(directoryPath)) return;
+
+    auto executable = llvm::MemoryBuffer::getFile(executablePath, -1, /* RequiresNullTerminator */ false);
+    if (!executable) return;
+
+    std::string dependencyList;
+    for (auto& dependency : dependencies) {
+        dependencyList += hashFile(dependency) + " " + dependency + "\n";
+    }
+
+    // Write the executable first: an entry is only looked up if its dependency list exists.
+    using namespace llvm::sys::fs;
+    if (!writeFileAtomically(directoryPath, getEntryPath(".out"), (*executable)->getBuffer(),
+                             all_read | all_write | all_exe)) {
+        return;
+    }
+    if (!writeFileAtomically(directoryPath, getEntryPath(".deps"), dependencyList, all_read | all_write)) {
+        return;
+    }
+
+    evictLeastRecentlyUsedEntries();
+}
+
+void RunCache::evictLeastRecentlyUsedEntries() const {
+    struct Entry {
+        std::string executablePath;
+        uint64_t size;
+        llvm::sys::TimePoint<> lastUseTime;
+    };
+
+    std::vector<Entry> entries;
+    uint64_t totalSize = 0;
+    std::error_code error;
+
+    for (llvm::sys::fs::directory_iterator it(directoryPath, error), end; it != end && !error; it.increment(error)) {
+        if (llvm::sys::path::extension(it->path()) != ".out") continue;
+        llvm::sys::fs::file_status status;
+        if (it->status(status)) continue;
+        entries.push_back({ it->path(), status.getSize(), status.getLastModificationTime() });
+        totalSize += status.getSize();
+    }
+
+    if (totalSize <= maxCacheSize) return;
+
+    std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) {
+        return a.lastUseTime < b.lastUseTime;
+    });
+
+    for (auto& entry : entries) {
+        if (totalSize <= maxCacheSize) break;
+        llvm::SmallString<128> dependenciesPath(entry.executablePath);
+        llvm::sys::path::replace_extension(dependenciesPath, "deps");
+        std::remove(dependenciesPath.c_str());
+        std::remove(entry.executablePath.c_str());
+        totalSize -= entry.size;
+    }
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <string>
+
+namespace llvm {
+template<typename T> class ArrayRef;
+class StringRef;
+}
+
+namespace delta {
+
+/// Cache of the executables built by 'delta run', stored in ~/.cache/delta/run. Entries are keyed on
+/// the contents of the input files, the compiler options, and the compiler binary. Each entry also
+/// records the content hashes of the other files the executable was built from, i.e. the transitively
+/// imported Delta modules and C headers, so that changes to them invalidate the entry.
+class RunCache {
+public:
+    RunCache(llvm::ArrayRef<std::string> inputFiles, llvm::ArrayRef<llvm::StringRef> args);
+    /// Returns the path of the cached executable, or an empty string if there's no up-to-date entry.
+    std::string lookup() const;
+    /// Adds a copy of the given executable to the cache, and evicts the least recently used entries
+    /// if the cache has grown too big. Failures are ignored, as the cache is only an optimization.
+    void store(llvm::StringRef executablePath, llvm::ArrayRef<std::string> dependencies) const;
+
+private:
+    std::string getEntryPath(llvm::StringRef extension) const;
+    void evictLeastRecentlyUsedEntries() const;
+
+private:
+    std::string directoryPath;
+    std::string key;
+};
+
+}
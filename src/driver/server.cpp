@@ -0,0 +1,428 @@
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <llvm/ADT/ArrayRef.h>
+#include <llvm/ADT/SmallString.h>
+#include <llvm/ADT/StringRef.h>
+#include <llvm/Support/Chrono.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/Path.h>
+#include <llvm/Support/raw_ostream.h>
+#include <llvm/Support/TargetSelect.h>
+#include "server.h"
+#include "driver.h"
+#include "../ast/compiler-instance.h"
+#include "../ast/module.h"
+#include "../parser/parse.h"
+#include "../sema/c-import.h"
+#include "../sema/typecheck.h"
+#include "../support/utility.h"
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+using namespace delta;
+
+namespace {
+
+/// The client's stdin, stdout, and stderr are passed to the server with each request.
+const int standardStreamCount = 3;
+
+std::string getDefaultSocketPath() {
+    if (auto* path = std::getenv("DELTA_SERVER_SOCKET")) {
+        if (*path) return path;
+    }
+
+    llvm::SmallString<128> path;
+    llvm::sys::path::system_temp_directory(/* erasedOnReboot */ true, path);
+    llvm::sys::path::append(path, "delta-server-" + std::to_string(getuid()) + ".sock");
+    return path.str();
+}
+
+bool makeSocketAddress(llvm::StringRef socketPath, sockaddr_un& address) {
+    if (socketPath.size() >= sizeof(address.sun_path)) return false;
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    std::memcpy(address.sun_path, socketPath.data(), socketPath.size());
+    return true;
+}
+
+/// Returns the connected socket, or -1 if no server is listening on `socketPath`.
+int connectToServer(llvm::StringRef socketPath) {
+    sockaddr_un address;
+    if (!makeSocketAddress(socketPath, address)) return -1;
+
+    int connection = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (connection < 0) return -1;
+
+    if (::connect(connection, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+        ::close(connection);
+        return -1;
+    }
+    return connection;
+}
+
+int createListeningSocket(const std::string& socketPath) {
+    sockaddr_un address;
+    if (!makeSocketAddress(socketPath, address)) {
+        printErrorAndExit("socket path '", socketPath, "' is too long");
+    }
+
+    int existingServer = connectToServer(socketPath);
+    if (existingServer >= 0) {
+        ::close(existingServer);
+        printErrorAndExit("a compiler server is already listening on '", socketPath, "'");
+    }
+    ::unlink(socketPath.c_str()); // Remove the socket file left behind by a previous server.
+
+    // Connections can make the server run programs as its user, so only that user may connect to the socket.
+    // The socket file is created with these permissions by bind(), so there's no window where it's open.
+    int listeningSocket = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listeningSocket < 0) {
+        printErrorAndExit("couldn't listen on '", socketPath, "': ", std::strerror(errno));
+    }
+    mode_t previousUmask = ::umask(S_IRWXG | S_IRWXO | S_IXUSR);
+    int bindResult = ::bind(listeningSocket, reinterpret_cast<sockaddr*>(&address), sizeof(address));
+    int bindError = errno;
+    ::umask(previousUmask);
+    if (bindResult != 0) {
+        printErrorAndExit("couldn't listen on '", socketPath, "': ", std::strerror(bindError));
+    }
+    if (::listen(listeningSocket, SOMAXCONN) != 0) {
+        printErrorAndExit("couldn't listen on '", socketPath, "': ", std::strerror(errno));
+    }
+    return listeningSocket;
+}
+
+/// Returns true if the peer of `connection` runs as the same user as the server. The socket's permissions
+/// already restrict who can connect, but they're not honored on all systems, e.g. by some BSDs.
+bool isConnectedToSameUser(int connection) {
+#ifdef SO_PEERCRED
+    ucred credentials;
+    socklen_t size = sizeof(credentials);
+    if (::getsockopt(connection, SOL_SOCKET, SO_PEERCRED, &credentials, &size) != 0) return false;
+    return credentials.uid == ::getuid();
+#else
+    uid_t uid;
+    gid_t gid;
+    if (::getpeereid(connection, &uid, &gid) != 0) return false;
+    return uid == ::getuid();
+#endif
+}
+
+bool writeAll(int fileDescriptor, const void* data, size_t size) {
+    auto* bytes = static_cast<const char*>(data);
+    while (size > 0) {
+        auto written = ::send(fileDescriptor, bytes, size, MSG_NOSIGNAL);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        bytes += written;
+        size -= written;
+    }
+    return true;
+}
+
+bool readAll(int fileDescriptor, void* data, size_t size) {
+    auto* bytes = static_cast<char*>(data);
+    while (size > 0) {
+        auto received = ::read(fileDescriptor, bytes, size);
+        if (received < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        if (received == 0) return false;
+        bytes += received;
+        size -= received;
+    }
+    return true;
+}
+
+/// A request consists of the size of the request body, sent together with the client's standard stream
+/// file descriptors, followed by the body: the working directory and the arguments, each null-terminated.
+bool sendRequest(int connection, llvm::StringRef body) {
+    uint32_t size = body.size();
+    int fileDescriptors[standardStreamCount] = { STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO };
+
+    iovec buffer = { &size, sizeof(size) };
+    char control[CMSG_SPACE(sizeof(fileDescriptors))] = {};
+    msghdr message = {};
+    message.msg_iov = &buffer;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+
+    cmsghdr* header = CMSG_FIRSTHDR(&message);
+    header->cmsg_level = SOL_SOCKET;
+    header->cmsg_type = SCM_RIGHTS;
+    header->cmsg_len = CMSG_LEN(sizeof(fileDescriptors));
+    std::memcpy(CMSG_DATA(header), fileDescriptors, sizeof(fileDescriptors));
+
+    if (::sendmsg(connection, &message, MSG_NOSIGNAL) != sizeof(size)) return false;
+    return writeAll(connection, body.data(), body.size());
+}
+
+bool receiveRequest(int connection, std::string& body, int (&fileDescriptors)[standardStreamCount]) {
+    uint32_t size;
+    iovec buffer = { &size, sizeof(size) };
+    char control[CMSG_SPACE(sizeof(fileDescriptors))] = {};
+    msghdr message = {};
+    message.msg_iov = &buffer;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+
+    if (::recvmsg(connection, &message, 0) != sizeof(size)) return false;
+
+    cmsghdr* header = CMSG_FIRSTHDR(&message);
+    if (!header || header->cmsg_type != SCM_RIGHTS || header->cmsg_len != CMSG_LEN(sizeof(fileDescriptors))) {
+        return false;
+    }
+    std::memcpy(fileDescriptors, CMSG_DATA(header), sizeof(fileDescriptors));
+
+    body.resize(size);
+    return size == 0 || readAll(connection, &body[0], size);
+}
+
+/// Runs the requested command in a process forked from the server's warm state, with the client's
+/// standard streams and working directory, and sends its exit status to the client.
+int serveConnection(int connection, CommandRunner& runCommand, CompilerInstance& compiler) {
+    std::signal(SIGCHLD, SIG_DFL); // Allow waiting for the command process.
+
+    std::string body;
+    int fileDescriptors[standardStreamCount];
+    if (!receiveRequest(connection, body, fileDescriptors)) return 1;
+
+    std::vector<const char*> args;
+    for (size_t position = 0; position < body.size(); position += std::strlen(&body[position]) + 1) {
+        args.push_back(&body[position]);
+    }
+    if (args.empty()) return 1;
+
+    auto startTime = std::chrono::steady_clock::now();
+    pid_t pid = ::fork();
+
+    if (pid == 0) {
+        for (int i = 0; i < standardStreamCount; ++i) {
+            ::dup2(fileDescriptors[i], i);
+        }
+        for (int fileDescriptor : fileDescriptors) {
+            if (fileDescriptor >= standardStreamCount) ::close(fileDescriptor);
+        }
+        ::close(connection);
+
+        if (::chdir(args[0]) != 0) {
+            printErrorAndExit("couldn't change to directory '", args[0], "': ", std::strerror(errno));
+        }
+
+        int exitStatus = runCommand(int(args.size() - 1), args.data() + 1, compiler);
+        std::cout.flush();
+        llvm::outs().flush();
+        std::exit(exitStatus);
+    }
+
+    for (int fileDescriptor : fileDescriptors) {
+        ::close(fileDescriptor);
+    }
+
+    int32_t exitStatus = 1;
+    if (pid > 0) {
+        int status;
+        while (::waitpid(pid, &status, 0) < 0 && errno == EINTR) {}
+        exitStatus = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+    }
+    writeAll(connection, &exitStatus, sizeof(exitStatus));
+
+    auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - startTime);
+    llvm::errs() << "served 'delta";
+    for (auto* arg : llvm::makeArrayRef(args).drop_front()) {
+        llvm::errs() << " " << arg;
+    }
+    llvm::errs() << "' in " << duration.count() << " ms, exit status " << exitStatus << "\n";
+    return 0;
+}
+
+using ResidentFileList = std::vector<std::pair<std::string, llvm::sys::TimePoint<>>>;
+
+/// Returns the source files and C headers of the currently imported modules, with their modification times.
+ResidentFileList getResidentFiles(const CompilerInstance& compiler) {
+    ResidentFileList residentFiles;
+    auto addFile = [&](llvm::StringRef filePath) {
+        llvm::sys::fs::file_status status;
+        if (llvm::sys::fs::status(filePath, status)) return;
+        residentFiles.emplace_back(filePath, status.getLastModificationTime());
+    };
+
+    for (auto* module : compiler.getImportedModules()) {
+        for (auto& sourceFile : module->getSourceFiles()) {
+            addFile(sourceFile.getFilePath());
+        }
+        for (auto& headerFile : module->getHeaderFiles()) {
+            addFile(headerFile);
+        }
+    }
+    return residentFiles;
+}
+
+bool hasChanged(const ResidentFileList& residentFiles) {
+    for (auto& residentFile : residentFiles) {
+        llvm::sys::fs::file_status status;
+        if (llvm::sys::fs::status(residentFile.first, status)) return true;
+        if (status.getLastModificationTime() != residentFile.second) return true;
+    }
+    return false;
+}
+
+/// Replaces the server process with a new one that reimports the resident modules, passing on the
+/// listening socket and the connection that is waiting to be served.
+[[noreturn]] void restart(llvm::ArrayRef<std::string> serverArgs, int listeningSocket, int pendingConnection) {
+    auto executablePath = llvm::sys::fs::getMainExecutable(nullptr, reinterpret_cast<void*>(&getDefaultSocketPath));
+
+    std::vector<std::string> args = { executablePath, "serve" };
+    for (auto& arg : serverArgs) {
+        if (!llvm::StringRef(arg).startswith("-socket-fd=") && !llvm::StringRef(arg).startswith("-connection-fd=")) {
+            args.push_back(arg);
+        }
+    }
+    args.push_back("-socket-fd=" + std::to_string(listeningSocket));
+    args.push_back("-connection-fd=" + std::to_string(pendingConnection));
+
+    std::vector<char*> argv;
+    for (auto& arg : args) {
+        argv.push_back(&arg[0]);
+    }
+    argv.push_back(nullptr);
+
+    llvm::errs() << "resident files changed, restarting\n";
+    llvm::errs().flush();
+    ::execv(argv[0], argv.data());
+    printErrorAndExit("couldn't restart the compiler server: ", std::strerror(errno));
+}
+
+} // anonymous namespace
+
+int delta::serveMain(std::vector<llvm::StringRef>& args, CommandRunner& runCommand) {
+    std::vector<std::string> serverArgs(args.begin(), args.end());
+    auto preloadedHeaders = collectStringOptionValues("-preload=", args);
+    auto socketPaths = collectStringOptionValues("-socket=", args);
+    // Internal options used when the server restarts itself.
+    auto socketFileDescriptors = collectStringOptionValues("-socket-fd=", args);
+    auto connectionFileDescriptors = collectStringOptionValues("-connection-fd=", args);
+
+    for (llvm::StringRef arg : args) {
+        printErrorAndExit("unsupported argument '", arg, "'");
+    }
+
+    auto socketPath = socketPaths.empty() ? getDefaultSocketPath() : socketPaths.back();
+    int listeningSocket = socketFileDescriptors.empty() ? createListeningSocket(socketPath)
+                                                        : std::stoi(socketFileDescriptors.back());
+    int pendingConnection = connectionFileDescriptors.empty() ? -1 : std::stoi(connectionFileDescriptors.back());
+
+    llvm::InitializeNativeTarget();
+    llvm::InitializeNativeTargetAsmPrinter();
+    llvm::InitializeNativeTargetAsmParser();
+
+    // Import the standard library and the preloaded C headers, to be inherited by every request.
+    CompilerInstance compiler;
+    Module module("server");
+    module.addSourceFile(SourceFile(llvm::StringRef()));
+    std::vector<std::string> importSearchPaths = { DELTA_ROOT_DIR };
+    typecheckModule(module, /* manifest */ nullptr, importSearchPaths, parse, compiler);
+
+    for (auto& header : preloadedHeaders) {
+        if (!importCHeader(module.getSourceFiles().front(), header, importSearchPaths, compiler)) {
+            printErrorAndExit("couldn't find C header '", header, "'");
+        }
+    }
+
+    auto residentFiles = getResidentFiles(compiler);
+
+    if (socketFileDescriptors.empty()) {
+        llvm::outs() << "listening on '" << socketPath << "'\n";
+        llvm::outs().flush();
+    }
+
+    std::signal(SIGCHLD, SIG_IGN); // Reap the connection-serving processes automatically.
+
+    while (true) {
+        int connection = pendingConnection;
+        pendingConnection = -1;
+
+        if (connection < 0) {
+            connection = ::accept(listeningSocket, nullptr, nullptr);
+            if (connection < 0) {
+                if (errno == EINTR) continue;
+                printErrorAndExit("couldn't accept connection: ", std::strerror(errno));
+            }
+
+            if (!isConnectedToSameUser(connection)) {
+                llvm::errs() << "rejected connection from another user\n";
+                ::close(connection);
+                continue;
+            }
+
+            if (hasChanged(residentFiles)) {
+                restart(serverArgs, listeningSocket, connection);
+            }
+        }
+
+        std::cout.flush();
+        llvm::outs().flush();
+        llvm::errs().flush();
+        pid_t pid = ::fork();
+
+        if (pid == 0) {
+            ::close(listeningSocket);
+            std::_Exit(serveConnection(connection, runCommand, compiler));
+        }
+
+        if (pid < 0) {
+            llvm::errs() << "couldn't fork: " << std::strerror(errno) << "\n";
+        }
+        ::close(connection);
+    }
+}
+
+llvm::Optional<int> delta::forwardToServer(int argc, const char** argv) {
+    auto* socketPath = std::getenv("DELTA_SERVER_SOCKET");
+    if (!socketPath || !*socketPath) return llvm::None;
+
+    // Compile locally if no server is running.
+    int connection = connectToServer(socketPath);
+    if (connection < 0) return llvm::None;
+
+    llvm::SmallString<128> currentPath;
+    if (llvm::sys::fs::current_path(currentPath)) {
+        ::close(connection);
+        return llvm::None;
+    }
+
+    std::string body = currentPath.str();
+    body += '\0';
+    for (int i = 0; i < argc; ++i) {
+        body += argv[i];
+        body += '\0';
+    }
+
+    int32_t exitStatus;
+    bool success = sendRequest(connection, body) && readAll(connection, &exitStatus, sizeof(exitStatus));
+    ::close(connection);
+
+    if (!success) printErrorAndExit("lost connection to the compiler server on '", socketPath, "'");
+    return int(exitStatus);
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <vector>
+#include <llvm/ADT/Optional.h>
+
+namespace llvm {
+class StringRef;
+}
+
+namespace delta {
+
+class CompilerInstance;
+
+/// Runs the command given by the command-line arguments (excluding the program name) in the given
+/// compilation context and returns the process exit status.
+using CommandRunner = int(int argc, const char** argv, CompilerInstance& compiler);
+
+/// Runs a compiler server that listens on a Unix socket for build requests forwarded by `delta`
+/// processes running in client mode. The standard library and the C headers given with '-preload='
+/// are imported once and kept resident; each request is served by a process forked from this warm
+/// state. If any resident file is modified, the server restarts itself to reload them.
+int serveMain(std::vector<llvm::StringRef>& args, CommandRunner& runCommand);
+
+/// If the DELTA_SERVER_SOCKET environment variable is set and a server is listening on that socket,
+/// forwards the command-line arguments, the working directory, and the standard streams to the
+/// server, and returns the exit status of the command. Otherwise returns llvm::None.
+llvm::Optional<int> forwardToServer(int argc, const char** argv);
+
+}
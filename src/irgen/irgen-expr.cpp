@@ -1,16 +1,13 @@
 #include "irgen.h"
+#include "../ast/mangle.h"
 #include "../support/utility.h"
 
 using namespace delta;
 
-namespace delta {
-extern llvm::LLVMContext ctx;
-}
-
 llvm::Value* IRGenerator::codegenVarExpr(const VarExpr& expr) {
     auto* value = findValue(expr.getIdentifier(), expr.getDecl());
 
-    if (llvm::isa<llvm::AllocaInst>(value) || llvm::isa<llvm::GlobalValue>(value) ||
+    if (llvm::isa<llvm::AllocaInst>(value) || llvm::isa<llvm::GlobalVariable>(value) ||
         llvm::isa<llvm::GetElementPtrInst>(value)) {
         return builder.CreateLoad(value, expr.getIdentifier());
     } else {
@@ -32,7 +29,13 @@ llvm::Value* IRGenerator::codegenStringLiteralExpr(const StringLiteralExpr& expr
                                                        stringPtr, 0);
         auto* size = llvm::ConstantInt::get(llvm::Type::getInt32Ty(ctx), expr.getValue().size());
         charArrayRef = builder.CreateInsertValue(charArrayRef, size, 1);
-        auto* initializer = functionInstantiations.at("string.init$stringLiteral:char[]&").getFunction();
+        // The initializer is called implicitly, so it's declared here rather than for a call expression.
+        auto initDecls = getTypeChecker().findDecls(mangleInitDecl("string"), /* everywhere */ true);
+        auto it = llvm::find_if(initDecls, [](const Decl* decl) {
+            return llvm::cast<InitDecl>(decl)->isStringLiteralInitializer();
+        });
+        ASSERT(it != initDecls.end());
+        auto* initializer = getInitProto(llvm::cast<InitDecl>(**it));
         return builder.CreateCall(initializer, charArrayRef);
     } else {
         // Passing as C-string, i.e. char pointer.
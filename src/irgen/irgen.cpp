@@ -3,25 +3,29 @@
 #include <vector>
 #include <memory>
 #include <llvm/ADT/STLExtras.h>
+#include <llvm/ADT/Statistic.h>
 #include <llvm/Support/ErrorHandling.h>
 #include <llvm/IR/IRBuilder.h>
 #include <llvm/IR/Function.h>
 #include <llvm/IR/Verifier.h>
 #include <llvm/IR/CFG.h>
 #include "irgen.h"
+#include "../ast/compiler-instance.h"
 #include "../ast/mangle.h"
 #include "../ast/expr.h"
 #include "../ast/decl.h"
 #include "../ast/module.h"
 #include "../ast/token.h"
 #include "../sema/typecheck.h"
+#include "../support/timing.h"
 #include "../support/utility.h"
 
-using namespace delta;
+#define DEBUG_TYPE "irgen"
 
-namespace delta {
-llvm::LLVMContext ctx;
-}
+STATISTIC(NumFunctionInstantiations, "Number of function instantiations created");
+STATISTIC(NumUnreachableFunctionsSkipped, "Number of functions not generated as unreachable from the entry points");
+
+using namespace delta;
 
 namespace {
 
@@ -49,8 +53,27 @@ void Scope::clear() {
     deinitsToCall.clear();
 }
 
-IRGenerator::IRGenerator()
-: builder(ctx), module("", ctx) {
+IRGenerator::IRGenerator(CompilerInstance& compiler)
+: compiler(compiler), ctx(compiler.getLLVMContext()), builder(ctx),
+  module(llvm::make_unique<llvm::Module>("", ctx)), builtinTypes({
+      { "void", llvm::Type::getVoidTy(ctx) },
+      { "bool", llvm::Type::getInt1Ty(ctx) },
+      { "char", llvm::Type::getInt8Ty(ctx) },
+      { "int", llvm::Type::getInt32Ty(ctx) },
+      { "int8", llvm::Type::getInt8Ty(ctx) },
+      { "int16", llvm::Type::getInt16Ty(ctx) },
+      { "int32", llvm::Type::getInt32Ty(ctx) },
+      { "int64", llvm::Type::getInt64Ty(ctx) },
+      { "uint", llvm::Type::getInt32Ty(ctx) },
+      { "uint8", llvm::Type::getInt8Ty(ctx) },
+      { "uint16", llvm::Type::getInt16Ty(ctx) },
+      { "uint32", llvm::Type::getInt32Ty(ctx) },
+      { "uint64", llvm::Type::getInt64Ty(ctx) },
+      { "float", llvm::Type::getFloatTy(ctx) },
+      { "float32", llvm::Type::getFloatTy(ctx) },
+      { "float64", llvm::Type::getDoubleTy(ctx) },
+      { "float80", llvm::Type::getX86_FP80Ty(ctx) },
+  }), generatesReachableFunctionsOnly(false), exportedModule(nullptr) {
     scopes.push_back(Scope(*this));
 }
 
@@ -93,6 +116,10 @@ llvm::Value* IRGenerator::findValue(llvm::StringRef name, const Decl* decl) {
         if (auto fieldDecl = llvm::dyn_cast<FieldDecl>(decl)) {
             return codegenMemberAccess(findValue("this", nullptr), fieldDecl->getType(), fieldDecl->getName());
         }
+        // A reference to a function evaluates to its address. Its body is generated like for a call.
+        if (auto* functionDecl = llvm::dyn_cast<FunctionDecl>(decl)) {
+            return getFunctionProto(*functionDecl);
+        }
         codegenDecl(*decl);
         if (auto* varDecl = llvm::dyn_cast<VarDecl>(decl)) {
             name = varDecl->getName();
@@ -102,26 +129,6 @@ llvm::Value* IRGenerator::findValue(llvm::StringRef name, const Decl* decl) {
     return value;
 }
 
-static const std::unordered_map<std::string, llvm::Type*> builtinTypes = {
-    { "void", llvm::Type::getVoidTy(ctx) },
-    { "bool", llvm::Type::getInt1Ty(ctx) },
-    { "char", llvm::Type::getInt8Ty(ctx) },
-    { "int", llvm::Type::getInt32Ty(ctx) },
-    { "int8", llvm::Type::getInt8Ty(ctx) },
-    { "int16", llvm::Type::getInt16Ty(ctx) },
-    { "int32", llvm::Type::getInt32Ty(ctx) },
-    { "int64", llvm::Type::getInt64Ty(ctx) },
-    { "uint", llvm::Type::getInt32Ty(ctx) },
-    { "uint8", llvm::Type::getInt8Ty(ctx) },
-    { "uint16", llvm::Type::getInt16Ty(ctx) },
-    { "uint32", llvm::Type::getInt32Ty(ctx) },
-    { "uint64", llvm::Type::getInt64Ty(ctx) },
-    { "float", llvm::Type::getFloatTy(ctx) },
-    { "float32", llvm::Type::getFloatTy(ctx) },
-    { "float64", llvm::Type::getDoubleTy(ctx) },
-    { "float80", llvm::Type::getX86_FP80Ty(ctx) },
-};
-
 llvm::Type* IRGenerator::toIR(Type type) {
     switch (type.getKind()) {
         case TypeKind::BasicType: {
@@ -213,7 +220,6 @@ void IRGenerator::codegenReturnStmt(const ReturnStmt& stmt) {
 
 llvm::AllocaInst* IRGenerator::createEntryBlockAlloca(Type type, llvm::Value* arraySize,
                                                       const llvm::Twine& name) {
-    static llvm::BasicBlock::iterator lastAlloca;
     auto* insertBlock = builder.GetInsertBlock();
     auto* entryBlock = &insertBlock->getParent()->getEntryBlock();
 
@@ -514,7 +520,7 @@ llvm::Function* IRGenerator::getFunctionProto(const FunctionLikeDecl& decl,
     if (decl.isMethodDecl() || decl.isDeinitDecl() || decl.isInitDecl()) {
         auto* receiverTypeDecl = decl.getTypeDecl();
         if (receiverTypeDecl->isGeneric()) {
-            mangledName = mangle(decl, receiverTypeGenericArgs, functionGenericArgs);
+            mangledName = mangleSymbol(decl, receiverTypeGenericArgs, functionGenericArgs);
             setCurrentGenericArgs(receiverTypeDecl->getGenericParams(), receiverTypeGenericArgs);
         }
 
@@ -533,9 +539,21 @@ llvm::Function* IRGenerator::getFunctionProto(const FunctionLikeDecl& decl,
     if (decl.getName() == "main" && returnType->isVoidTy()) returnType = llvm::Type::getInt32Ty(ctx);
 
     auto* llvmFunctionType = llvm::FunctionType::get(returnType, paramTypes, decl.isVariadic());
-    if (mangledName.empty()) mangledName = mangle(decl, receiverTypeGenericArgs, functionGenericArgs);
+    if (mangledName.empty()) {
+        // Generic instantiations get compact symbol names, as their full names grow quickly when nested.
+        if (functionGenericArgs.empty()) {
+            mangledName = mangle(decl, receiverTypeGenericArgs);
+        } else {
+            mangledName = mangleSymbol(decl, receiverTypeGenericArgs, functionGenericArgs);
+        }
+    }
     auto* function = llvm::Function::Create(llvmFunctionType, llvm::Function::ExternalLinkage,
-                                            mangledName, &module);
+                                            mangledName, module.get());
+    if (!targetCPU.empty()) function->addFnAttr("target-cpu", targetCPU);
+    if (!targetFeatures.empty()) function->addFnAttr("target-features", targetFeatures);
+    if (!currentUnitFilePaths.empty() && (!receiverTypeGenericArgs.empty() || !functionGenericArgs.empty())) {
+        function->setLinkage(llvm::Function::LinkOnceODRLinkage);
+    }
 
     auto arg = function->arg_begin(), argsEnd = function->arg_end();
     if (decl.isMethodDecl() || decl.isDeinitDecl()) arg++->setName("this");
@@ -547,6 +565,7 @@ llvm::Function* IRGenerator::getFunctionProto(const FunctionLikeDecl& decl,
 
     auto mangled = mangleWithParams(decl, receiverTypeGenericArgs, functionGenericArgs);
     FunctionInstantiation functionInstantiation{decl, receiverTypeGenericArgs, functionGenericArgs, function};
+    ++NumFunctionInstantiations;
     return functionInstantiations.emplace(std::move(mangled),
                                           std::move(functionInstantiation)).first->second.getFunction();
 }
@@ -581,6 +600,7 @@ llvm::Function* IRGenerator::getFunctionForCall(const CallExpr& call) {
 }
 
 void IRGenerator::codegenFunctionBody(const FunctionLikeDecl& decl, llvm::Function& function) {
+    TimeScope timeScope("IRGen function", function.getName());
     builder.SetInsertPoint(llvm::BasicBlock::Create(ctx, "", &function));
     beginScope();
     auto arg = function.arg_begin();
@@ -611,18 +631,22 @@ void IRGenerator::codegenFunctionBody(const FunctionLikeDecl& decl, llvm::Functi
 void IRGenerator::codegenFunctionDecl(const FunctionDecl& decl) {
     if (decl.isGeneric()) return;
     if (decl.getTypeDecl() && decl.getTypeDecl()->isGeneric()) return;
+    if (decl.hasUncheckedBody()) return; // Not called by the program.
 
     llvm::Function* function = getFunctionProto(decl);
-    if (!decl.isExtern()) codegenFunctionBody(decl, *function);
+    // Deferred bodies are generated later by compileDeferredFunction().
+    if (decl.getBody()) codegenFunctionBody(decl, *function);
     ASSERT(!llvm::verifyFunction(*function, &llvm::errs()));
 }
 
 void IRGenerator::codegenInitDecl(const InitDecl& decl, llvm::ArrayRef<Type> typeGenericArgs) {
     if (decl.getTypeDecl()->isGeneric() && typeGenericArgs.empty()) return;
+    if (decl.hasUncheckedBody()) return; // Not called by the program.
     SAVE_STATE(currentGenericArgs);
     setCurrentGenericArgs(decl.getTypeDecl()->getGenericParams(), typeGenericArgs);
 
     llvm::Function* function = getInitProto(decl, typeGenericArgs);
+    if (!decl.getBody()) return;
 
     builder.SetInsertPoint(llvm::BasicBlock::Create(ctx, "", function));
 
@@ -648,7 +672,7 @@ void IRGenerator::codegenDeinitDecl(const DeinitDecl& decl, llvm::ArrayRef<Type>
     if (decl.getTypeDecl()->isGeneric() && typeGenericArgs.empty()) return;
 
     llvm::Function* function = getFunctionProto(decl, {}, decl.getTypeDecl()->getType(typeGenericArgs));
-    codegenFunctionBody(decl, *function);
+    if (decl.getBody()) codegenFunctionBody(decl, *function);
     ASSERT(!llvm::verifyFunction(*function, &llvm::errs()));
 }
 
@@ -671,8 +695,11 @@ void IRGenerator::codegenTypeDecl(const TypeDecl& decl) {
     auto insertBlockBackup = builder.GetInsertBlock();
     auto insertPointBackup = builder.GetInsertPoint();
 
-    for (auto& memberDecl : decl.getMemberDecls()) {
-        codegenDecl(*memberDecl);
+    // The members of types defined in other compilation units are declared when they're used.
+    if (isInCurrentUnit(decl)) {
+        for (auto& memberDecl : decl.getMemberDecls()) {
+            codegenDecl(*memberDecl);
+        }
     }
 
     if (insertBlockBackup) builder.SetInsertPoint(insertBlockBackup, insertPointBackup);
@@ -702,7 +729,14 @@ void IRGenerator::codegenVarDecl(const VarDecl& decl) {
     if (!value || decl.getType().isMutable() /* || decl.isPublic() */) {
         auto linkage = value ? llvm::GlobalValue::PrivateLinkage : llvm::GlobalValue::ExternalLinkage;
         auto initializer = value ? llvm::cast<llvm::Constant>(value) : nullptr;
-        value = new llvm::GlobalVariable(module, toIR(decl.getType()), !decl.getType().isMutable(),
+
+        if (value && !currentUnitFilePaths.empty()) {
+            // Other compilation units reference the variable through an external declaration.
+            linkage = llvm::GlobalValue::ExternalLinkage;
+            if (!isInCurrentUnit(decl)) initializer = nullptr;
+        }
+
+        value = new llvm::GlobalVariable(*module, toIR(decl.getType()), !decl.getType().isMutable(),
                                          linkage, initializer, decl.getName());
     }
 
@@ -710,6 +744,12 @@ void IRGenerator::codegenVarDecl(const VarDecl& decl) {
 }
 
 void IRGenerator::codegenDecl(const Decl& decl) {
+    if (generatesReachableFunctionsOnly) {
+        auto* functionLikeDecl = llvm::dyn_cast<FunctionLikeDecl>(&decl);
+        // Generated by codegenFunctionInstantiations() once getFunctionForCall() has declared it for a call.
+        if (functionLikeDecl && !isEntryPoint(*functionLikeDecl)) return;
+    }
+
     SAVE_STATE(currentDecl);
     currentDecl = &decl;
 
@@ -728,22 +768,129 @@ void IRGenerator::codegenDecl(const Decl& decl) {
 }
 
 llvm::Module& IRGenerator::compile(const Module& sourceModule) {
+    TimeScope timeScope("IRGen", sourceModule.getName());
     for (const auto& sourceFile : sourceModule.getSourceFiles()) {
         setTypeChecker(TypeChecker(const_cast<Module*>(&sourceModule),
-                                   const_cast<SourceFile*>(&sourceFile)));
+                                   const_cast<SourceFile*>(&sourceFile), compiler));
 
         for (const auto& decl : sourceFile.getTopLevelDecls()) {
             codegenDecl(*decl);
         }
     }
 
+    codegenFunctionInstantiations(sourceModule);
+    ASSERT(!llvm::verifyModule(*module, &llvm::errs()));
+    return *module;
+}
+
+llvm::Module& IRGenerator::compile(const Module& sourceModule, const SourceFile& sourceFile,
+                                   llvm::ArrayRef<Decl*> decls) {
+    setTypeChecker(TypeChecker(const_cast<Module*>(&sourceModule), const_cast<SourceFile*>(&sourceFile),
+                               compiler));
+
+    for (const Decl* decl : decls) {
+        codegenDecl(*decl);
+    }
+
+    codegenFunctionInstantiations(sourceModule);
+    ASSERT(!llvm::verifyModule(*module, &llvm::errs()));
+    return *module;
+}
+
+llvm::Module& IRGenerator::compileUnit(const Module& sourceModule,
+                                       llvm::ArrayRef<const SourceFile*> sourceFiles) {
+    TimeScope timeScope("IRGen", sourceModule.getName());
+    for (auto* sourceFile : sourceFiles) {
+        currentUnitFilePaths.insert(sourceFile->getFilePath());
+    }
+
+    for (auto* sourceFile : sourceFiles) {
+        setTypeChecker(TypeChecker(const_cast<Module*>(&sourceModule), const_cast<SourceFile*>(sourceFile),
+                                   compiler));
+
+        for (const auto& decl : sourceFile->getTopLevelDecls()) {
+            codegenDecl(*decl);
+        }
+    }
+
+    codegenFunctionInstantiations(sourceModule);
+    ASSERT(!llvm::verifyModule(*module, &llvm::errs()));
+    return *module;
+}
+
+llvm::Function& IRGenerator::compileDeferredFunction(const Module& sourceModule, const SourceFile& sourceFile,
+                                                     const FunctionLikeDecl& decl) {
+    setTypeChecker(TypeChecker(const_cast<Module*>(&sourceModule), const_cast<SourceFile*>(&sourceFile),
+                               compiler));
+    codegenDecl(decl);
+    codegenFunctionInstantiations(sourceModule);
+    // The prototype was already created when the declarations of the module were compiled.
+    return *getFunctionProto(decl);
+}
+
+llvm::Module& IRGenerator::compileExecutable(const Module& mainModule, bool exportsMainModule) {
+    SAVE_STATE(generatesReachableFunctionsOnly);
+    SAVE_STATE(exportedModule);
+    generatesReachableFunctionsOnly = true;
+    exportedModule = exportsMainModule ? &mainModule : nullptr;
+
+    // Declares the types and global variables, and generates the entry points and everything they call.
+    for (auto* importedModule : compiler.getImportedModules()) {
+        compile(*importedModule);
+    }
+    compile(mainModule);
+
+    if (llvm::AreStatisticsEnabled()) {
+        auto countIfSkipped = [&](const FunctionLikeDecl& decl) {
+            if (!decl.getBody() || decl.hasGenericBody()) return;
+            auto it = functionInstantiations.find(mangleWithParams(decl));
+            if (it == functionInstantiations.end() || it->second.getFunction()->empty()) {
+                ++NumUnreachableFunctionsSkipped;
+            }
+        };
+
+        auto modules = compiler.getImportedModules();
+        modules.push_back(const_cast<Module*>(&mainModule));
+        for (auto* sourceModule : modules) {
+            for (auto& sourceFile : sourceModule->getSourceFiles()) {
+                for (auto& decl : sourceFile.getTopLevelDecls()) {
+                    if (auto* functionDecl = llvm::dyn_cast<FunctionDecl>(decl.get())) {
+                        countIfSkipped(*functionDecl);
+                    } else if (auto* typeDecl = llvm::dyn_cast<TypeDecl>(decl.get())) {
+                        for (auto& memberDecl : typeDecl->getMemberDecls()) {
+                            countIfSkipped(*memberDecl);
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    return *module;
+}
+
+bool IRGenerator::isEntryPoint(const FunctionLikeDecl& decl) const {
+    if (exportedModule && decl.getModule() == exportedModule) return true;
+    return decl.getName() == "main" && !decl.getTypeDecl();
+}
+
+bool IRGenerator::isInCurrentUnit(const Decl& decl) const {
+    if (currentUnitFilePaths.empty()) return true;
+    auto* filePath = decl.getLocation().file;
+    return filePath && currentUnitFilePaths.count(filePath);
+}
+
+void IRGenerator::codegenFunctionInstantiations(const Module& sourceModule) {
     while (true) {
         auto currentFunctionInstantiations = functionInstantiations;
 
         for (auto& p : currentFunctionInstantiations) {
-            if (p.second.getDecl().isExtern() || !p.second.getFunction()->empty()) continue;
+            // Extern functions, deferred bodies, and bodies in prebuilt libraries have no body to generate.
+            if (!p.second.getDecl().getBody() || !p.second.getFunction()->empty()) continue;
+            if (p.second.isDefinedInPreviousModule()) continue;
+            if (!p.second.isGeneric() && !isInCurrentUnit(p.second.getDecl())) continue;
 
-            setTypeChecker(TypeChecker(const_cast<Module*>(&sourceModule), nullptr));
+            setTypeChecker(TypeChecker(const_cast<Module*>(&sourceModule), nullptr, compiler));
 
             SAVE_STATE(currentGenericArgs);
             setCurrentGenericArgs(p.second.getDecl().getGenericParams(), p.second.getGenericArgs());
@@ -751,17 +898,41 @@ llvm::Module& IRGenerator::compile(const Module& sourceModule) {
                 setCurrentGenericArgs(p.second.getDecl().getTypeDecl()->getGenericParams(),
                                       p.second.getReceiverTypeGenericArgs());
             }
-            codegenFunctionBody(p.second.getDecl(), *p.second.getFunction());
+            if (auto* initDecl = llvm::dyn_cast<InitDecl>(&p.second.getDecl())) {
+                codegenInitDecl(*initDecl, p.second.getReceiverTypeGenericArgs());
+            } else {
+                codegenFunctionBody(p.second.getDecl(), *p.second.getFunction());
+            }
             ASSERT(!llvm::verifyFunction(*p.second.getFunction(), &llvm::errs()));
         }
 
         if (functionInstantiations.size() == currentFunctionInstantiations.size()) break;
     }
-
-    ASSERT(!llvm::verifyModule(module, &llvm::errs()));
-    return module;
 }
 
-llvm::LLVMContext& irgen::getContext() {
-    return ctx;
+std::unique_ptr<llvm::Module> IRGenerator::takeModule() {
+    auto previousModule = std::move(module);
+    module = llvm::make_unique<llvm::Module>("", ctx);
+    builder.ClearInsertionPoint();
+    lastAlloca = llvm::BasicBlock::iterator();
+
+    for (auto& p : functionInstantiations) {
+        auto* function = p.second.getFunction();
+        auto* declaration = llvm::Function::Create(function->getFunctionType(), llvm::Function::ExternalLinkage,
+                                                   function->getName(), module.get());
+        p.second.setDeclarationInNewModule(declaration);
+    }
+
+    for (auto& p : globalScope().getLocalValues()) {
+        auto* globalVariable = llvm::dyn_cast<llvm::GlobalVariable>(p.second);
+        if (!globalVariable) continue;
+
+        // Private globals couldn't be referenced from the new module.
+        globalVariable->setLinkage(llvm::GlobalValue::ExternalLinkage);
+        p.second = new llvm::GlobalVariable(*module, globalVariable->getValueType(), globalVariable->isConstant(),
+                                            llvm::GlobalValue::ExternalLinkage, nullptr,
+                                            globalVariable->getName());
+    }
+
+    return previousModule;
 }
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <llvm/ADT/StringSet.h>
 #include <llvm/IR/IRBuilder.h>
 #include <llvm/IR/Module.h>
 #include "../ast/expr.h"
@@ -9,16 +10,12 @@
 
 namespace delta {
 
+class CompilerInstance;
 class Module;
 struct Type;
 class TypeChecker;
 class IRGenerator;
 
-namespace irgen {
-llvm::Type* getBuiltinType(llvm::StringRef typeName);
-llvm::LLVMContext& getContext();
-}
-
 struct Scope {
     Scope(IRGenerator& irGenerator) : irGenerator(irGenerator) {}
     void addDeferredExpr(const Expr& expr) { deferredExprs.emplace_back(&expr); }
@@ -30,6 +27,7 @@ struct Scope {
         ASSERT(didInsert);
     }
     const std::unordered_map<std::string, llvm::Value*>& getLocalValues() const { return localValues; }
+    std::unordered_map<std::string, llvm::Value*>& getLocalValues() { return localValues; }
     void onScopeEnd();
     void clear();
 
@@ -42,14 +40,42 @@ private:
 
 class IRGenerator : public TypeResolver {
 public:
-    IRGenerator();
+    explicit IRGenerator(CompilerInstance& compiler);
 
     const TypeChecker& getTypeChecker() const { return *currentTypeChecker; }
     void setTypeChecker(TypeChecker&& typeChecker) { currentTypeChecker = std::move(typeChecker); }
     llvm::Module& compile(const Module& sourceModule);
+    /// Generates IR for the given top-level declarations of `sourceFile`, e.g. those entered on a REPL line.
+    llvm::Module& compile(const Module& sourceModule, const SourceFile& sourceFile,
+                          llvm::ArrayRef<Decl*> decls);
+    /// Generates IR for a separately compiled unit consisting of the given source files. Functions and
+    /// mutable global variables defined outside the unit are only declared, while generic instantiations
+    /// get linkonce_odr linkage so that the linker can merge the copies emitted by different units.
+    llvm::Module& compileUnit(const Module& sourceModule, llvm::ArrayRef<const SourceFile*> sourceFiles);
+    /// Generates IR for an executable consisting of `mainModule` and the modules imported into the compiler,
+    /// starting from its entry points: 'main', and every function of `mainModule` if `exportsMainModule` is
+    /// true, e.g. because C code linked into the executable may call them. Other functions are generated
+    /// only once a generated function calls them, so the unused functions of the libraries aren't compiled.
+    llvm::Module& compileExecutable(const Module& mainModule, bool exportsMainModule);
+    /// Generates the body of a function that was compiled before its body was parsed, i.e. whose body has
+    /// since been parsed by parseDeferredFunctionBody(), and the generic instantiations referenced by it.
+    llvm::Function& compileDeferredFunction(const Module& sourceModule, const SourceFile& sourceFile,
+                                            const FunctionLikeDecl& decl);
+    /// Generates the bodies of the referenced function instantiations that don't have a body yet.
+    void codegenFunctionInstantiations(const Module& sourceModule);
+    llvm::Module& getIRModule() { return *module; }
+    /// Transfers the ownership of the generated LLVM module to the caller, e.g. for JIT execution.
+    /// Code generated after this goes into a new module that references the functions and global
+    /// variables of the previous one through external declarations.
+    std::unique_ptr<llvm::Module> takeModule();
     llvm::Value* codegenExpr(const Expr& expr);
     llvm::Type* toIR(Type type);
     llvm::IRBuilder<>& getBuilder() { return builder; }
+    /// Sets the 'target-cpu' and 'target-features' attributes to add to every generated function.
+    void setTargetCPU(llvm::StringRef cpu, llvm::StringRef features) {
+        targetCPU = cpu;
+        targetFeatures = features;
+    }
     Type resolveTypePlaceholder(llvm::StringRef name) const override;
 
 private:
@@ -62,9 +88,10 @@ private:
 
     void setCurrentGenericArgs(llvm::ArrayRef<GenericParamDecl> genericParams,
                                llvm::ArrayRef<Type> genericArgs);
+    bool isInCurrentUnit(const Decl& decl) const;
+    bool isEntryPoint(const FunctionLikeDecl& decl) const;
     void codegenFunctionBody(const FunctionLikeDecl& decl, llvm::Function& function);
     void createDeinitCall(llvm::Function* deinit, llvm::Value* valueToDeinit);
-    llvm::Module& getIRModule() { return module; }
 
     llvm::Function* getDeinitializerFor(Type type);
     /// @param type The Delta type of the variable, or null if the variable is 'this'.
@@ -153,31 +180,52 @@ private:
         FunctionInstantiation(const FunctionLikeDecl& decl, llvm::ArrayRef<Type> receiverTypeGenericArgs,
                               llvm::ArrayRef<Type> genericArgs, llvm::Function* function)
         : decl(decl), receiverTypeGenericArgs(receiverTypeGenericArgs), genericArgs(genericArgs),
-          function(function) {}
+          function(function), definedInPreviousModule(false) {}
         const FunctionLikeDecl& getDecl() const { return decl; }
         llvm::ArrayRef<Type> getReceiverTypeGenericArgs() const { return receiverTypeGenericArgs; }
         llvm::ArrayRef<Type> getGenericArgs() const { return genericArgs; }
         llvm::Function* getFunction() const { return function; }
+        /// Replaces the function with a declaration of it in a new module, see takeModule().
+        void setDeclarationInNewModule(llvm::Function* declaration) {
+            function = declaration;
+            definedInPreviousModule = true;
+        }
+        bool isDefinedInPreviousModule() const { return definedInPreviousModule; }
+        bool isGeneric() const { return !receiverTypeGenericArgs.empty() || !genericArgs.empty(); }
 
     private:
         const FunctionLikeDecl& decl;
         llvm::ArrayRef<Type> receiverTypeGenericArgs;
         llvm::ArrayRef<Type> genericArgs;
         llvm::Function* function;
+        bool definedInPreviousModule;
     };
 
 private:
+    CompilerInstance& compiler;
+    llvm::LLVMContext& ctx;
     llvm::Optional<TypeChecker> currentTypeChecker;
     llvm::SmallVector<Scope, 4> scopes;
 
     llvm::IRBuilder<> builder;
-    llvm::Module module;
+    std::unique_ptr<llvm::Module> module;
+    const std::unordered_map<std::string, llvm::Type*> builtinTypes;
 
     std::unordered_map<std::string, FunctionInstantiation> functionInstantiations;
     std::vector<std::unique_ptr<FunctionDecl>> helperDecls;
     std::unordered_map<std::string, std::pair<llvm::StructType*, const TypeDecl*>> structs;
     std::unordered_map<std::string, Type> currentGenericArgs;
     const Decl* currentDecl;
+    llvm::BasicBlock::iterator lastAlloca;
+    std::string targetCPU;
+    std::string targetFeatures;
+    /// The source files of the unit being compiled by compileUnit(), or empty if compiling whole modules.
+    llvm::StringSet<> currentUnitFilePaths;
+    /// True while compileExecutable() is generating IR, which defers the functions that aren't entry points
+    /// to codegenFunctionInstantiations().
+    bool generatesReachableFunctionsOnly;
+    /// The module whose functions are all entry points in compileExecutable(), or null.
+    const Module* exportedModule;
 
     /// The basic blocks to branch to on a 'break' statement, one element per scope.
     llvm::SmallVector<llvm::BasicBlock*, 4> breakTargets;
@@ -2,6 +2,7 @@
 #include <vector>
 #include <string>
 #include <unordered_map>
+#include <llvm/ADT/Statistic.h>
 #include <llvm/ADT/StringRef.h>
 #include <llvm/Support/ErrorHandling.h>
 #include <llvm/Support/MemoryBuffer.h>
@@ -9,30 +10,44 @@
 #include "../ast/token.h"
 #include "../support/utility.h"
 
+#define DEBUG_TYPE "lexer"
+
+STATISTIC(NumTokensLexed, "Number of tokens lexed");
+
 using namespace delta;
 
 namespace {
 
-std::vector<std::unique_ptr<llvm::MemoryBuffer>> fileBuffers;
-const char* currentFilePosition;
+thread_local const char* currentFilePosition;
 
 }
 
 namespace delta {
 
-extern const char* currentFilePath;
-extern SourceLocation firstLocation;
-extern SourceLocation lastLocation;
+extern thread_local const char* currentFilePath;
+extern thread_local SourceLocation firstLocation;
+extern thread_local SourceLocation lastLocation;
 
-void initLexer(std::unique_ptr<llvm::MemoryBuffer> input) {
-    currentFilePath = input->getBufferIdentifier().data();
-    fileBuffers.emplace_back(std::move(input));
-    currentFilePosition = fileBuffers.back()->getBufferStart() - 1;
+void initLexer(const llvm::MemoryBuffer& input) {
+    currentFilePath = input.getBufferIdentifier().data();
+    currentFilePosition = input.getBufferStart() - 1;
 
     firstLocation = SourceLocation(currentFilePath, 1, 0);
     lastLocation = SourceLocation(currentFilePath, 1, 0);
 }
 
+const char* getLexerPosition() {
+    return currentFilePosition;
+}
+
+void resumeLexer(const char* position, SourceLocation location) {
+    currentFilePath = location.file;
+    currentFilePosition = position - 1;
+
+    firstLocation = SourceLocation(currentFilePath, location.line, location.column - 1);
+    lastLocation = firstLocation;
+}
+
 }
 
 namespace {
@@ -200,9 +215,7 @@ const std::unordered_map<std::string, TokenKind> keywords = {
     {"_",             UNDERSCORE},
 };
 
-} // anonymous namespace
-
-Token delta::lex() {
+Token lexToken() {
     while (true) {
         char ch = readChar();
         firstLocation.line = lastLocation.line;
@@ -376,3 +389,10 @@ Token delta::lex() {
 end:
     return NO_TOKEN;
 }
+
+} // anonymous namespace
+
+Token delta::lex() {
+    ++NumTokensLexed;
+    return lexToken();
+}
@@ -1,6 +1,6 @@
 #pragma once
 
-#include <memory>
+#include "../ast/location.h"
 
 namespace llvm {
 class MemoryBuffer;
@@ -10,7 +10,14 @@ namespace delta {
 
 struct Token;
 
-void initLexer(std::unique_ptr<llvm::MemoryBuffer> input);
+/// Starts lexing the given buffer, which must stay alive while its tokens are in use.
+void initLexer(const llvm::MemoryBuffer& input);
 Token lex();
+/// Returns a pointer to the last character read from the buffer, i.e. the last character of the most
+/// recently lexed token.
+const char* getLexerPosition();
+/// Continues lexing from `position`, which must point into a buffer that has been passed to initLexer(),
+/// and whose source location is `location`.
+void resumeLexer(const char* position, SourceLocation location);
 
 }
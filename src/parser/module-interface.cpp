@@ -0,0 +1,240 @@
+#include <algorithm>
+#include <climits>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+#include <llvm/ADT/SmallString.h>
+#include <llvm/ADT/StringMap.h>
+#include <llvm/ADT/StringRef.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/LEB128.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/Path.h>
+#include <llvm/Support/raw_ostream.h>
+#include <clang/Basic/VirtualFileSystem.h>
+#include "module-interface.h"
+#include "lex.h"
+#include "../ast/compiler-instance.h"
+#include "../ast/decl.h"
+#include "../ast/module.h"
+#include "../ast/token.h"
+#include "../sema/typecheck.h"
+#include "../support/utility.h"
+
+using namespace delta;
+
+namespace delta {
+extern thread_local const char* currentFilePath;
+extern thread_local SourceLocation firstLocation;
+}
+
+namespace {
+
+const char magic[] = "DELTAI";
+/// Incremented whenever the format changes, or the token kinds are renumbered.
+const uint8_t formatVersion = 1;
+
+/// Returns the locations of the functions in `sourceFile` whose bodies are compiled into the library of the
+/// module, i.e. the non-generic functions that aren't extern.
+std::set<std::pair<short, short>> getLibraryFunctionLocations(const SourceFile& sourceFile) {
+    std::set<std::pair<short, short>> locations;
+    auto addLocation = [&](const FunctionLikeDecl& decl) {
+        if (decl.isExtern() || decl.hasGenericBody()) return;
+        locations.emplace(decl.getLocation().line, decl.getLocation().column);
+    };
+
+    for (auto& decl : sourceFile.getTopLevelDecls()) {
+        if (auto* functionDecl = llvm::dyn_cast<FunctionDecl>(decl.get())) {
+            addLocation(*functionDecl);
+        } else if (auto* typeDecl = llvm::dyn_cast<TypeDecl>(decl.get())) {
+            for (auto& memberDecl : typeDecl->getMemberDecls()) {
+                addLocation(*memberDecl);
+            }
+        }
+    }
+    return locations;
+}
+
+/// Lexes `source` and returns its tokens, except the bodies of the functions declared at the given
+/// locations. The body is the first brace-delimited block after the function's location.
+std::vector<Token> getInterfaceTokens(const llvm::MemoryBuffer& source,
+                                      const std::set<std::pair<short, short>>& libraryFunctionLocations) {
+    std::vector<Token> tokens;
+    bool skipNextBody = false;
+    int skippedBodyDepth = 0;
+    initLexer(source);
+
+    for (Token token = lex(); token != NO_TOKEN; token = lex()) {
+        if (skippedBodyDepth > 0) {
+            if (token == LBRACE) skippedBodyDepth++;
+            if (token == RBRACE) skippedBodyDepth--;
+        } else if (skipNextBody && token == LBRACE) {
+            skippedBodyDepth = 1;
+            skipNextBody = false;
+        } else {
+            tokens.push_back(token);
+            auto location = token.getLocation();
+            if (libraryFunctionLocations.count({ location.line, location.column })) skipNextBody = true;
+        }
+    }
+
+    return tokens;
+}
+
+} // anonymous namespace
+
+void delta::writeModuleInterface(llvm::ArrayRef<Token> tokens, llvm::StringRef sourceFilePath,
+                                 llvm::raw_ostream& stream) {
+    std::vector<llvm::StringRef> strings;
+    llvm::StringMap<size_t> stringIndices;
+    std::vector<size_t> tokenStringIndices;
+
+    for (auto& token : tokens) {
+        if (token.getString().empty()) {
+            tokenStringIndices.push_back(0);
+            continue;
+        }
+        // String indices are 1-based, as 0 stands for a token without a string.
+        auto inserted = stringIndices.insert({ token.getString(), strings.size() + 1 });
+        if (inserted.second) strings.push_back(token.getString());
+        tokenStringIndices.push_back(inserted.first->second);
+    }
+
+    stream << magic;
+    stream << char(formatVersion);
+    stream << sourceFilePath << '\0';
+
+    llvm::encodeULEB128(strings.size(), stream);
+    for (auto string : strings) {
+        llvm::encodeULEB128(string.size(), stream);
+        stream << string;
+    }
+
+    llvm::encodeULEB128(tokens.size(), stream);
+    short previousLine = 1;
+    for (size_t i = 0; i < tokens.size(); ++i) {
+        auto location = tokens[i].getLocation();
+        ASSERT(location.line >= previousLine);
+        stream << char(tokens[i].getKind());
+        llvm::encodeULEB128(tokenStringIndices[i], stream);
+        llvm::encodeULEB128(location.line - previousLine, stream);
+        llvm::encodeULEB128(location.column, stream);
+        previousLine = location.line;
+    }
+}
+
+void delta::writeModuleInterfaceDirectory(const Module& module, llvm::StringRef directoryPath,
+                                          llvm::StringRef libraryPath, CompilerInstance& compiler) {
+    if (auto error = llvm::sys::fs::create_directories(directoryPath)) {
+        printErrorAndExit("couldn't create '", directoryPath, "': ", error.message());
+    }
+
+    // Remove the previous interface, starting with its stamp so that it isn't used while partially replaced,
+    // as the interface files of source files that no longer exist would otherwise be imported as well.
+    llvm::SmallString<128> stampPath(directoryPath);
+    llvm::sys::path::append(stampPath, moduleInterfaceStampFileName);
+    llvm::sys::fs::remove(stampPath);
+    std::error_code error;
+    for (llvm::sys::fs::recursive_directory_iterator it(directoryPath, error), end; it != end && !error;
+         it.increment(error)) {
+        if (llvm::sys::path::extension(it->path()) == ".deltai") llvm::sys::fs::remove(it->path());
+    }
+
+    for (auto& sourceFile : module.getSourceFiles()) {
+        auto sourceFilePath = sourceFile.getFilePath();
+        auto buffer = compiler.getFileSystem().getBufferForFile(sourceFilePath);
+        if (!buffer) printErrorAndExit("couldn't read '", sourceFilePath, "'");
+        auto& source = compiler.addFileBuffer(std::move(*buffer));
+        auto tokens = getInterfaceTokens(source, getLibraryFunctionLocations(sourceFile));
+
+        llvm::SmallString<128> interfaceFilePath(directoryPath);
+        auto relativePath = getModuleRelativePath(sourceFilePath, module.getSourceDirectory());
+        llvm::sys::path::append(interfaceFilePath, relativePath);
+        llvm::sys::path::replace_extension(interfaceFilePath, "deltai");
+        auto interfaceDirectoryPath = llvm::sys::path::parent_path(interfaceFilePath);
+        if (auto error = llvm::sys::fs::create_directories(interfaceDirectoryPath)) {
+            printErrorAndExit("couldn't create '", interfaceDirectoryPath, "': ", error.message());
+        }
+        llvm::raw_fd_ostream file(interfaceFilePath, error, llvm::sys::fs::F_None);
+        if (error) printErrorAndExit("couldn't write '", interfaceFilePath, "': ", error.message());
+        writeModuleInterface(tokens, sourceFilePath, file);
+    }
+
+    auto sourceHash = hashModuleDirectory(module.getSourceDirectory(), compiler);
+    if (sourceHash.empty()) printErrorAndExit("couldn't read '", module.getSourceDirectory(), "'");
+
+    // Written last, so that a partially written interface isn't used.
+    llvm::raw_fd_ostream stamp(stampPath, error, llvm::sys::fs::F_None);
+    if (error) printErrorAndExit("couldn't write '", stampPath, "': ", error.message());
+    stamp << sourceHash << '\n' << libraryPath << '\n';
+}
+
+ModuleInterfaceReader::ModuleInterfaceReader(const llvm::MemoryBuffer& buffer)
+: bufferIdentifier(buffer.getBufferIdentifier()),
+  position(reinterpret_cast<const uint8_t*>(buffer.getBufferStart())),
+  end(reinterpret_cast<const uint8_t*>(buffer.getBufferEnd())), line(1) {
+    if (!buffer.getBuffer().startswith(magic)) reportInvalidInterface();
+    position += sizeof(magic) - 1;
+    if (readByte() != formatVersion) {
+        printErrorAndExit("module interface '", bufferIdentifier, "' was written by an incompatible compiler");
+    }
+
+    auto pathEnd = std::find(position, end, '\0');
+    if (pathEnd == end) reportInvalidInterface();
+    sourceFilePath = reinterpret_cast<const char*>(position);
+    position = pathEnd + 1;
+
+    auto stringCount = readVarint();
+    strings.reserve(stringCount);
+    while (stringCount-- > 0) {
+        strings.push_back(readString(readVarint()));
+    }
+
+    remainingTokenCount = readVarint();
+    firstLocation = SourceLocation(sourceFilePath, 1, 1);
+}
+
+Token ModuleInterfaceReader::readToken() {
+    currentFilePath = sourceFilePath;
+    if (remainingTokenCount == 0) return Token(NO_TOKEN);
+    remainingTokenCount--;
+
+    auto kind = readByte();
+    auto stringIndex = readVarint();
+    line += readVarint();
+    auto column = readVarint();
+
+    if (kind == NO_TOKEN || kind >= TOKEN_COUNT || stringIndex > strings.size()
+        || (stringIndex == 0 && kind < BREAK) || line > SHRT_MAX || column == 0 || column > SHRT_MAX) {
+        reportInvalidInterface();
+    }
+
+    firstLocation = SourceLocation(sourceFilePath, short(line), short(column));
+    return Token(TokenKind(kind), stringIndex == 0 ? llvm::StringRef() : strings[stringIndex - 1]);
+}
+
+uint8_t ModuleInterfaceReader::readByte() {
+    if (position == end) reportInvalidInterface();
+    return *position++;
+}
+
+uint64_t ModuleInterfaceReader::readVarint() {
+    unsigned length;
+    const char* error = nullptr;
+    auto value = llvm::decodeULEB128(position, &length, end, &error);
+    if (error) reportInvalidInterface();
+    position += length;
+    return value;
+}
+
+llvm::StringRef ModuleInterfaceReader::readString(size_t length) {
+    if (length > size_t(end - position)) reportInvalidInterface();
+    llvm::StringRef string(reinterpret_cast<const char*>(position), length);
+    position += length;
+    return string;
+}
+
+void ModuleInterfaceReader::reportInvalidInterface() const {
+    printErrorAndExit("invalid module interface '", bufferIdentifier, "'");
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <llvm/ADT/ArrayRef.h>
+#include <llvm/ADT/StringRef.h>
+
+namespace llvm {
+class MemoryBuffer;
+class raw_ostream;
+}
+
+namespace delta {
+
+class CompilerInstance;
+class Module;
+struct Token;
+
+/// Writes a binary module interface (.deltai) containing the given tokens of `sourceFilePath`. The token
+/// strings are stored once in a string table and the source locations as line deltas, so that the
+/// interface is compact and can be read without lexing.
+void writeModuleInterface(llvm::ArrayRef<Token> tokens, llvm::StringRef sourceFilePath,
+                          llvm::raw_ostream& stream);
+/// Writes the module interface of each source file of the imported `module` into `directoryPath`, after it
+/// has been type-checked, followed by the stamp that makes importers use the interfaces in place of the
+/// sources and link `libraryPath` for the code of the module. The interfaces consist of the tokens of the
+/// source files without the bodies of non-generic functions, which are compiled into the library. They are
+/// laid out in the same subdirectories as the source files.
+void writeModuleInterfaceDirectory(const Module& module, llvm::StringRef directoryPath,
+                                   llvm::StringRef libraryPath, CompilerInstance& compiler);
+
+/// Produces the tokens of a binary module interface in place of the lexer. The tokens have the source
+/// locations of the original source file, and their strings point into `buffer`, which must stay alive
+/// while the tokens are in use.
+class ModuleInterfaceReader {
+public:
+    explicit ModuleInterfaceReader(const llvm::MemoryBuffer& buffer);
+    /// Returns the next token, or NO_TOKEN at the end of the interface.
+    Token readToken();
+
+private:
+    uint8_t readByte();
+    uint64_t readVarint();
+    llvm::StringRef readString(size_t length);
+    [[noreturn]] void reportInvalidInterface() const;
+
+private:
+    llvm::StringRef bufferIdentifier;
+    const uint8_t* position;
+    const uint8_t* end;
+    const char* sourceFilePath;
+    std::vector<llvm::StringRef> strings;
+    uint64_t remainingTokenCount;
+    uint64_t line;
+};
+
+}
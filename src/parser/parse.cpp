@@ -1,30 +1,56 @@
+#include <deque>
+#include <string>
 #include <vector>
 #include <forward_list>
 #include <sstream>
 #include <llvm/ADT/ArrayRef.h>
+#include <llvm/ADT/Optional.h>
 #include <llvm/ADT/StringRef.h>
 #include <llvm/ADT/STLExtras.h>
+#include <llvm/ADT/Statistic.h>
 #include <llvm/Support/ErrorHandling.h>
 #include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/Path.h>
+#include <clang/Basic/VirtualFileSystem.h>
 #include "parse.h"
 #include "lex.h"
+#include "module-interface.h"
 #include "../ast/token.h"
 #include "../ast/decl.h"
+#include "../ast/compiler-instance.h"
 #include "../ast/module.h"
 #include "../sema/typecheck.h"
+#include "../support/memory-stats.h"
+#include "../support/timing.h"
 #include "../support/utility.h"
 
 using namespace delta;
 
+#define DEBUG_TYPE "parser"
+
+STATISTIC(NumFunctionBodiesSkipped, "Number of function bodies skipped by -stream-functions");
+STATISTIC(NumSkippedFunctionBodiesParsed, "Number of skipped function bodies parsed when compiled");
+
 namespace delta {
-extern const char* currentFilePath;
+extern thread_local const char* currentFilePath;
 }
 
 namespace {
 
-std::vector<Token> tokenBuffer;
-size_t currentTokenIndex;
-Module* currentModule;
+// The parser state is thread-local so that multiple compilations can parse files concurrently.
+thread_local std::deque<Token> tokenBuffer;
+thread_local size_t currentTokenIndex;
+thread_local Module* currentModule;
+/// Set by parseSignatures() to skip the bodies of non-generic functions.
+thread_local bool deferFunctionBodies = false;
+/// Set while parsing a module interface, in which non-generic functions have no body.
+thread_local bool parsingInterface = false;
+/// The source of the tokens while parsing a module interface, in place of the lexer.
+thread_local llvm::Optional<ModuleInterfaceReader> interfaceReader;
+
+Token nextToken() {
+    return interfaceReader ? interfaceReader->readToken() : lex();
+}
 
 Token currentToken() {
     ASSERT(currentTokenIndex < tokenBuffer.size());
@@ -38,17 +64,26 @@ SourceLocation getCurrentLocation() {
 Token lookAhead(int offset) {
     if (int(currentTokenIndex) + offset < 0) return NO_TOKEN;
     int count = int(currentTokenIndex) + offset - int(tokenBuffer.size()) + 1;
-    while (count-- > 0) tokenBuffer.emplace_back(lex());
+    while (count-- > 0) tokenBuffer.emplace_back(nextToken());
     return tokenBuffer[currentTokenIndex + offset];
 }
 
 Token consumeToken() {
     Token token = currentToken();
     if (++currentTokenIndex == tokenBuffer.size())
-        tokenBuffer.emplace_back(lex());
+        tokenBuffer.emplace_back(nextToken());
     return token;
 }
 
+/// Frees the consumed tokens except the previous one, which is needed by lookAhead(-1), so that the
+/// token buffer doesn't grow with the size of the file. Must not be called while backtracking is possible.
+void releaseConsumedTokens() {
+    while (currentTokenIndex > 1) {
+        tokenBuffer.pop_front();
+        currentTokenIndex--;
+    }
+}
+
 /// Adds quotes around the string representation of the given token unless
 /// it's an identifier, numeric literal, string literal, or end-of-file.
 std::string quote(TokenKind tokenKind) {
@@ -86,8 +121,8 @@ Token parse(llvm::ArrayRef<TokenKind> expected, const char* contextInfo = nullpt
 
 static void checkStmtTerminatorConsistency(TokenKind currentTerminator,
                                            llvm::function_ref<SourceLocation()> getLocation) {
-    static TokenKind previousTerminator = NO_TOKEN;
-    static const char* filePath = nullptr;
+    static thread_local TokenKind previousTerminator = NO_TOKEN;
+    static thread_local const char* filePath = nullptr;
 
     if (filePath != delta::currentFilePath) {
         filePath = delta::currentFilePath;
@@ -869,13 +904,56 @@ std::unique_ptr<FunctionDecl> parseFunctionProto(TypeDecl* receiverTypeDecl) {
     }
 }
 
-/// function-decl ::= function-proto '{' stmt* '}'
+/// Skips the tokens of a function body starting at the current '{' without building an AST for them.
+void skipFunctionBody() {
+    int depth = 0;
+    do {
+        switch (currentToken()) {
+            case LBRACE: depth++; break;
+            case RBRACE: depth--; break;
+            case NO_TOKEN: unexpectedToken(currentToken(), RBRACE);
+            default: break;
+        }
+        consumeToken();
+        releaseConsumedTokens();
+    } while (depth > 0);
+}
+
+/// If called from parseSignatures(), skips the body of `decl` starting at the current '{', records its
+/// position for parseDeferredFunctionBody(), and returns true. Generic bodies are always parsed eagerly,
+/// because they're type-checked and instantiated on demand.
+bool deferFunctionBody(FunctionLikeDecl& decl) {
+    if (!deferFunctionBodies || decl.hasGenericBody()) return false;
+    // The lexer position is only known for the most recently lexed token.
+    if (currentTokenIndex != tokenBuffer.size() - 1) return false;
+
+    decl.setDeferredBody(getLexerPosition(), getCurrentLocation());
+    skipFunctionBody();
+    ++NumFunctionBodiesSkipped;
+    return true;
+}
+
+/// function-body ::= '{' stmt* '}'
+void parseFunctionBody(FunctionLikeDecl& decl) {
+    if (parsingInterface && currentToken() != LBRACE) {
+        // The body was left out of the interface because it's compiled into the module's library.
+        decl.releaseBody();
+        return;
+    }
+
+    expect(LBRACE, nullptr);
+    if (deferFunctionBody(decl)) return;
+
+    consumeToken();
+    decl.setBody(std::make_shared<std::vector<std::unique_ptr<Stmt>>>(parseStmtsUntil(RBRACE)));
+    parse(RBRACE);
+}
+
+/// function-decl ::= function-proto function-body
 std::unique_ptr<FunctionDecl> parseFunctionDecl(TypeDecl* receiverTypeDecl, bool requireBody = true) {
     auto decl = parseFunctionProto(receiverTypeDecl);
     if (requireBody || currentToken() == LBRACE) {
-        parse(LBRACE);
-        decl->setBody(std::make_shared<std::vector<std::unique_ptr<Stmt>>>(parseStmtsUntil(RBRACE)));
-        parse(RBRACE);
+        parseFunctionBody(*decl);
     }
     return decl;
 }
@@ -889,27 +967,24 @@ std::unique_ptr<FunctionDecl> parseExternFunctionDecl() {
     return decl;
 }
 
-/// init-decl ::= 'init' param-list '{' stmt* '}'
+/// init-decl ::= 'init' param-list function-body
 std::unique_ptr<InitDecl> parseInitDecl(TypeDecl& receiverTypeDecl) {
     auto initLocation = parse(INIT).getLocation();
     auto params = parseParamList();
-    parse(LBRACE);
-    auto body = std::make_shared<std::vector<std::unique_ptr<Stmt>>>(parseStmtsUntil(RBRACE));
-    parse(RBRACE);
-    return llvm::make_unique<InitDecl>(receiverTypeDecl, std::move(params), std::move(body),
-                                       initLocation);
+    auto decl = llvm::make_unique<InitDecl>(receiverTypeDecl, std::move(params), nullptr, initLocation);
+    parseFunctionBody(*decl);
+    return decl;
 }
 
-/// deinit-decl ::= 'deinit' '(' ')' '{' stmt* '}'
+/// deinit-decl ::= 'deinit' '(' ')' function-body
 std::unique_ptr<DeinitDecl> parseDeinitDecl(TypeDecl& receiverTypeDecl) {
     auto deinitLocation = parse(DEINIT).getLocation();
     parse(LPAREN);
     auto expectedRParenLocation = getCurrentLocation();
     if (consumeToken() != RPAREN) error(expectedRParenLocation, "deinitializers cannot have parameters");
-    parse(LBRACE);
-    auto body = std::make_shared<std::vector<std::unique_ptr<Stmt>>>(parseStmtsUntil(RBRACE));
-    parse(RBRACE);
-    return llvm::make_unique<DeinitDecl>(receiverTypeDecl, std::move(body), deinitLocation);
+    auto decl = llvm::make_unique<DeinitDecl>(receiverTypeDecl, nullptr, deinitLocation);
+    parseFunctionBody(*decl);
+    return decl;
 }
 
 /// field-decl ::= ('let' | 'var') id ':' type ('\n' | ';')
@@ -1022,22 +1097,31 @@ std::unique_ptr<Decl> parseTopLevelDecl(const TypeChecker& typeChecker) {
     }
 }
 
-void initParser(std::unique_ptr<llvm::MemoryBuffer> input) {
-    initLexer(std::move(input));
+void initParser(std::unique_ptr<llvm::MemoryBuffer> input, CompilerInstance& compiler) {
+    auto& buffer = compiler.addFileBuffer(std::move(input));
+    if (parsingInterface) {
+        interfaceReader.emplace(buffer);
+    } else {
+        interfaceReader.reset();
+        initLexer(buffer);
+    }
     tokenBuffer.clear();
     currentTokenIndex = 0;
-    tokenBuffer.emplace_back(lex());
+    tokenBuffer.emplace_back(nextToken());
 }
 
-SourceFile parse(std::unique_ptr<llvm::MemoryBuffer> input, Module& module) {
+SourceFile parse(std::unique_ptr<llvm::MemoryBuffer> input, Module& module, CompilerInstance& compiler) {
     std::string identifier = input->getBufferIdentifier();
-    initParser(std::move(input));
+    TimeScope timeScope("Parse", identifier);
+    HeapUsageScope heapUsageScope("AST and source buffers per module", module.getName());
+    initParser(std::move(input), compiler);
     std::vector<std::unique_ptr<Decl>> topLevelDecls;
     SourceFile sourceFile(identifier);
-    TypeChecker typeChecker(&module, &sourceFile);
+    TypeChecker typeChecker(&module, &sourceFile, compiler);
 
     while (currentToken() != NO_TOKEN) {
         topLevelDecls.emplace_back(parseTopLevelDecl(typeChecker));
+        releaseConsumedTokens();
     }
 
     sourceFile.setDecls(std::move(topLevelDecls));
@@ -1046,17 +1130,65 @@ SourceFile parse(std::unique_ptr<llvm::MemoryBuffer> input, Module& module) {
 
 }
 
-void delta::parse(llvm::StringRef filePath, Module& module) {
-    auto buffer = llvm::MemoryBuffer::getFile(filePath);
+void delta::parse(llvm::StringRef filePath, Module& module, CompilerInstance& compiler) {
+    SAVE_STATE(parsingInterface);
+    parsingInterface = llvm::sys::path::extension(filePath) == ".deltai";
+
+    // Module interfaces don't need a null terminator, which allows the file system to map them into memory.
+    auto buffer = compiler.getFileSystem().getBufferForFile(filePath, /* FileSize */ -1,
+                                                            /* RequiresNullTerminator */ !parsingInterface);
     if (!buffer) printErrorAndExit("no such file: '", filePath, "'");
+    parseSourceFile(std::move(*buffer), module, compiler);
+}
+
+void delta::parseSignatures(llvm::StringRef filePath, Module& module, CompilerInstance& compiler) {
+    SAVE_STATE(deferFunctionBodies);
+    deferFunctionBodies = true;
+    parse(filePath, module, compiler);
+}
+
+void delta::parseDeferredFunctionBody(FunctionLikeDecl& decl, Module& module) {
+    ASSERT(decl.hasDeferredBody());
+    TimeScope timeScope("Parse function", decl.getName());
+    SAVE_STATE(deferFunctionBodies);
+    deferFunctionBodies = false;
+    currentModule = &module;
+
+    interfaceReader.reset();
+    resumeLexer(decl.getDeferredBodyStart(), decl.getDeferredBodyLocation());
+    tokenBuffer.clear();
+    currentTokenIndex = 0;
+    tokenBuffer.emplace_back(nextToken());
+    ::parseFunctionBody(decl);
+    ++NumSkippedFunctionBodiesParsed;
+}
 
+void delta::parseSourceFile(std::unique_ptr<llvm::MemoryBuffer> input, Module& module,
+                            CompilerInstance& compiler) {
     currentModule = &module;
-    module.addSourceFile(::parse(std::move(*buffer), module));
+    module.addSourceFile(::parse(std::move(input), module, compiler));
 }
 
-std::unique_ptr<Expr> delta::parseExpr(std::unique_ptr<llvm::MemoryBuffer> input,
-                                       Module& module) {
-    initParser(std::move(input));
+std::unique_ptr<Expr> delta::parseExpr(std::unique_ptr<llvm::MemoryBuffer> input, Module& module,
+                                       CompilerInstance& compiler) {
+    initParser(std::move(input), compiler);
     currentModule = &module;
     return ::parseExpr();
 }
+
+std::vector<Decl*> delta::parseTopLevelDecls(std::unique_ptr<llvm::MemoryBuffer> input, Module& module,
+                                             SourceFile& sourceFile, CompilerInstance& compiler) {
+    initParser(std::move(input), compiler);
+    currentModule = &module;
+    TypeChecker typeChecker(&module, &sourceFile, compiler);
+    std::vector<Decl*> decls;
+
+    while (currentToken() != NO_TOKEN) {
+        auto decl = parseTopLevelDecl(typeChecker);
+        decls.push_back(decl.get());
+        sourceFile.addDecl(std::move(decl));
+        releaseConsumedTokens();
+    }
+
+    return decls;
+}
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <memory>
+#include <vector>
 #include <llvm/Support/MemoryBuffer.h>
 
 namespace llvm {
@@ -9,10 +10,28 @@ class StringRef;
 
 namespace delta {
 
+class CompilerInstance;
 class Module;
+class SourceFile;
+class Decl;
 class Expr;
+class FunctionLikeDecl;
 
-void parse(llvm::StringRef filePath, Module& module);
-std::unique_ptr<Expr> parseExpr(std::unique_ptr<llvm::MemoryBuffer> input, Module& module);
+/// Reads the given file through the file system of `compiler`, and parses it into `module`. Files with the
+/// '.deltai' extension are read as binary module interfaces, whose non-generic functions have no body.
+void parse(llvm::StringRef filePath, Module& module, CompilerInstance& compiler);
+/// Like parse(), but skips the bodies of non-generic functions, so that they can be parsed one at a time
+/// with parseDeferredFunctionBody() when they're compiled.
+void parseSignatures(llvm::StringRef filePath, Module& module, CompilerInstance& compiler);
+/// Parses the body of `decl` that was skipped by parseSignatures(). The source buffer is still owned by
+/// the CompilerInstance that was passed to parseSignatures().
+void parseDeferredFunctionBody(FunctionLikeDecl& decl, Module& module);
+/// Parses a source file from memory into `module`. The buffer identifier is used as the file name.
+void parseSourceFile(std::unique_ptr<llvm::MemoryBuffer> input, Module& module, CompilerInstance& compiler);
+std::unique_ptr<Expr> parseExpr(std::unique_ptr<llvm::MemoryBuffer> input, Module& module,
+                                CompilerInstance& compiler);
+/// Parses the top-level declarations in `input`, appends them to `sourceFile`, and returns them.
+std::vector<Decl*> parseTopLevelDecls(std::unique_ptr<llvm::MemoryBuffer> input, Module& module,
+                                      SourceFile& sourceFile, CompilerInstance& compiler);
 
 }
@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <vector>
 #include <memory>
 #include <cstdlib>
@@ -11,27 +12,26 @@
 #include <clang/Lex/Preprocessor.h>
 #include <clang/Lex/HeaderSearch.h>
 #include <clang/Parse/ParseAST.h>
+#include <clang/AST/ASTContext.h>
 #include <clang/AST/Decl.h>
 #include <clang/AST/DeclGroup.h>
 #include <clang/AST/Type.h>
 #include <clang/AST/PrettyPrinter.h>
 #include "c-import.h"
 #include "typecheck.h"
+#include "../ast/compiler-instance.h"
 #include "../ast/type.h"
 #include "../ast/decl.h"
 #include "../ast/module.h"
+#include "../support/memory-stats.h"
+#include "../support/timing.h"
 #include "../support/utility.h"
 
 using namespace delta;
 
-namespace delta {
-extern std::unordered_map<std::string, std::shared_ptr<Module>> allImportedModules;
-}
-
 namespace {
 
 clang::PrintingPolicy printingPolicy{clang::LangOptions()};
-clang::TargetInfo* targetInfo;
 
 Type getIntTypeByWidth(int widthInBits, bool asSigned) {
     switch (widthInBits) {
@@ -43,22 +43,22 @@ Type getIntTypeByWidth(int widthInBits, bool asSigned) {
     llvm_unreachable("unsupported integer width");
 }
 
-Type toDelta(const clang::BuiltinType& type) {
+Type toDelta(const clang::BuiltinType& type, const clang::TargetInfo& targetInfo) {
     switch (type.getKind()) {
         case clang::BuiltinType::Void: return Type::getVoid();
         case clang::BuiltinType::Bool: return Type::getBool();
         case clang::BuiltinType::Char_S:
         case clang::BuiltinType::Char_U: return Type::getChar();
-        case clang::BuiltinType::SChar: return getIntTypeByWidth(targetInfo->getCharWidth(), true);
-        case clang::BuiltinType::UChar: return getIntTypeByWidth(targetInfo->getCharWidth(), false);
-        case clang::BuiltinType::Short: return getIntTypeByWidth(targetInfo->getShortWidth(), true);
-        case clang::BuiltinType::UShort: return getIntTypeByWidth(targetInfo->getShortWidth(), false);
+        case clang::BuiltinType::SChar: return getIntTypeByWidth(targetInfo.getCharWidth(), true);
+        case clang::BuiltinType::UChar: return getIntTypeByWidth(targetInfo.getCharWidth(), false);
+        case clang::BuiltinType::Short: return getIntTypeByWidth(targetInfo.getShortWidth(), true);
+        case clang::BuiltinType::UShort: return getIntTypeByWidth(targetInfo.getShortWidth(), false);
         case clang::BuiltinType::Int: return Type::getInt();
         case clang::BuiltinType::UInt: return Type::getUInt();
-        case clang::BuiltinType::Long: return getIntTypeByWidth(targetInfo->getLongWidth(), true);
-        case clang::BuiltinType::ULong: return getIntTypeByWidth(targetInfo->getLongWidth(), false);
-        case clang::BuiltinType::LongLong: return getIntTypeByWidth(targetInfo->getLongLongWidth(), true);
-        case clang::BuiltinType::ULongLong: return getIntTypeByWidth(targetInfo->getLongLongWidth(), false);
+        case clang::BuiltinType::Long: return getIntTypeByWidth(targetInfo.getLongWidth(), true);
+        case clang::BuiltinType::ULong: return getIntTypeByWidth(targetInfo.getLongWidth(), false);
+        case clang::BuiltinType::LongLong: return getIntTypeByWidth(targetInfo.getLongLongWidth(), true);
+        case clang::BuiltinType::ULongLong: return getIntTypeByWidth(targetInfo.getLongLongWidth(), false);
         case clang::BuiltinType::Float: return Type::getFloat32();
         case clang::BuiltinType::Double: return Type::getFloat64();
         case clang::BuiltinType::LongDouble: return Type::getFloat80();
@@ -67,33 +67,33 @@ Type toDelta(const clang::BuiltinType& type) {
     llvm_unreachable("unsupported builtin type");
 }
 
-Type toDelta(clang::QualType qualtype) {
+Type toDelta(clang::QualType qualtype, const clang::TargetInfo& targetInfo) {
     const bool isMutable = !qualtype.isConstQualified();
     auto& type = *qualtype.getTypePtr();
     switch (type.getTypeClass()) {
         case clang::Type::Pointer: {
             auto pointeeType = llvm::cast<clang::PointerType>(type).getPointeeType();
-            return PointerType::get(toDelta(pointeeType), false, isMutable);
+            return PointerType::get(toDelta(pointeeType, targetInfo), false, isMutable);
         }
         case clang::Type::Builtin: {
-            Type deltaType = toDelta(llvm::cast<clang::BuiltinType>(type));
+            Type deltaType = toDelta(llvm::cast<clang::BuiltinType>(type), targetInfo);
             deltaType.setMutable(isMutable);
             return deltaType;
         }
         case clang::Type::Typedef:
-            return toDelta(llvm::cast<clang::TypedefType>(type).desugar());
+            return toDelta(llvm::cast<clang::TypedefType>(type).desugar(), targetInfo);
         case clang::Type::Elaborated:
-            return toDelta(llvm::cast<clang::ElaboratedType>(type).getNamedType());
+            return toDelta(llvm::cast<clang::ElaboratedType>(type).getNamedType(), targetInfo);
         case clang::Type::Record:
             return BasicType::get(llvm::cast<clang::RecordType>(type).getDecl()->getName(),
                                   {}, isMutable);
         case clang::Type::Paren:
-            return toDelta(llvm::cast<clang::ParenType>(type).getInnerType());
+            return toDelta(llvm::cast<clang::ParenType>(type).getInnerType(), targetInfo);
         case clang::Type::FunctionProto: {
             auto& functionProtoType = llvm::cast<clang::FunctionProtoType>(type);
             auto paramTypes = map(functionProtoType.getParamTypes(),
-                                  [](clang::QualType qualType) { return toDelta(qualType); });
-            return FunctionType::get(toDelta(functionProtoType.getReturnType()),
+                                  [&](clang::QualType qualType) { return toDelta(qualType, targetInfo); });
+            return FunctionType::get(toDelta(functionProtoType.getReturnType(), targetInfo),
                                      std::move(paramTypes), isMutable);
         }
         case clang::Type::ConstantArray: {
@@ -101,16 +101,17 @@ Type toDelta(clang::QualType qualtype) {
             if (!constantArrayType.getSize().isIntN(64)) {
                 fatalError("array is too large");
             }
-            return ArrayType::get(toDelta(constantArrayType.getElementType()),
+            return ArrayType::get(toDelta(constantArrayType.getElementType(), targetInfo),
                                   constantArrayType.getSize().getLimitedValue(), isMutable);
         }
-        case clang::Type::IncompleteArray:
-            return ArrayType::get(toDelta(llvm::cast<clang::IncompleteArrayType>(type).getElementType()),
-                                  ArrayType::unsized);
+        case clang::Type::IncompleteArray: {
+            auto elementType = llvm::cast<clang::IncompleteArrayType>(type).getElementType();
+            return ArrayType::get(toDelta(elementType, targetInfo), ArrayType::unsized);
+        }
         case clang::Type::Attributed:
-            return toDelta(llvm::cast<clang::AttributedType>(type).getEquivalentType());
+            return toDelta(llvm::cast<clang::AttributedType>(type).getEquivalentType(), targetInfo);
         case clang::Type::Decayed:
-            return toDelta(llvm::cast<clang::DecayedType>(type).getDecayedType());
+            return toDelta(llvm::cast<clang::DecayedType>(type).getDecayedType(), targetInfo);
         case clang::Type::Enum:
         case clang::Type::Vector:
             return Type::getInt(); // FIXME: Temporary.
@@ -122,18 +123,20 @@ Type toDelta(clang::QualType qualtype) {
 }
 
 FunctionDecl toDelta(const clang::FunctionDecl& decl, Module* currentModule) {
-    auto params = map(decl.parameters(), [](clang::ParmVarDecl* param) {
-        return ParamDecl(toDelta(param->getType()), param->getNameAsString(), SourceLocation::invalid());
+    auto& targetInfo = decl.getASTContext().getTargetInfo();
+    auto params = map(decl.parameters(), [&](clang::ParmVarDecl* param) {
+        return ParamDecl(toDelta(param->getType(), targetInfo), param->getNameAsString(),
+                         SourceLocation::invalid());
     });
-    FunctionProto proto(decl.getNameAsString(), std::move(params), toDelta(decl.getReturnType()),
+    FunctionProto proto(decl.getNameAsString(), std::move(params), toDelta(decl.getReturnType(), targetInfo),
                         /* genericParams */ {}, decl.isVariadic());
     return FunctionDecl(std::move(proto), *currentModule, SourceLocation::invalid());
 }
 
 llvm::Optional<FieldDecl> toDelta(const clang::FieldDecl& decl, TypeDecl& typeDecl) {
     if (decl.getName().empty()) return llvm::None;
-    return FieldDecl(toDelta(decl.getType()), decl.getNameAsString(), typeDecl,
-                     SourceLocation::invalid());
+    return FieldDecl(toDelta(decl.getType(), decl.getASTContext().getTargetInfo()), decl.getNameAsString(),
+                     typeDecl, SourceLocation::invalid());
 }
 
 llvm::Optional<TypeDecl> toDelta(const clang::RecordDecl& decl, Module* currentModule) {
@@ -153,7 +156,8 @@ llvm::Optional<TypeDecl> toDelta(const clang::RecordDecl& decl, Module* currentM
 }
 
 VarDecl toDelta(const clang::VarDecl& decl, Module* currentModule) {
-    return VarDecl(toDelta(decl.getType()), decl.getName(), nullptr, *currentModule, SourceLocation::invalid());
+    return VarDecl(toDelta(decl.getType(), decl.getASTContext().getTargetInfo()), decl.getName(), nullptr,
+                   *currentModule, SourceLocation::invalid());
 }
 
 void addIntegerConstantToSymbolTable(llvm::StringRef name, int64_t value, const TypeChecker& typeChecker) {
@@ -270,15 +274,16 @@ static void addHeaderSearchPathsFromEnvVar(clang::CompilerInstance& ci, const ch
 }
 
 bool delta::importCHeader(SourceFile& importer, llvm::StringRef headerName,
-                          llvm::ArrayRef<std::string> importSearchPaths) {
-    auto it = allImportedModules.find(headerName);
-    if (it != allImportedModules.end()) {
-        importer.addImportedModule(it->second);
+                          llvm::ArrayRef<std::string> importSearchPaths, CompilerInstance& compiler) {
+    if (auto importedModule = compiler.getImportedModule(headerName)) {
+        importer.addImportedModule(importedModule);
         return true;
     }
 
+    TimeScope timeScope("Import C header", headerName);
+    HeapUsageScope heapUsageScope("Retained C header modules", headerName);
     auto module = std::make_shared<Module>(headerName);
-    TypeChecker typeChecker(module.get(), nullptr);
+    TypeChecker typeChecker(module.get(), nullptr, compiler);
 
     clang::CompilerInstance ci;
     clang::DiagnosticOptions diagnosticOptions;
@@ -286,9 +291,9 @@ bool delta::importCHeader(SourceFile& importer, llvm::StringRef headerName,
 
     std::shared_ptr<clang::TargetOptions> pto = std::make_shared<clang::TargetOptions>();
     pto->Triple = llvm::sys::getDefaultTargetTriple();
-    targetInfo = clang::TargetInfo::CreateTargetInfo(ci.getDiagnostics(), pto);
-    ci.setTarget(targetInfo);
+    ci.setTarget(clang::TargetInfo::CreateTargetInfo(ci.getDiagnostics(), pto));
 
+    ci.setVirtualFileSystem(compiler.getFileSystemPtr());
     ci.createFileManager();
     ci.createSourceManager(ci.getFileManager());
 
@@ -321,7 +326,19 @@ bool delta::importCHeader(SourceFile& importer, llvm::StringRef headerName,
     clang::ParseAST(ci.getPreprocessor(), &ci.getASTConsumer(), ci.getASTContext());
     ci.getDiagnosticClient().EndSourceFile();
 
+    // Record the header and everything it includes, sorted because the source manager's file map is
+    // unordered, for dependency tracking.
+    auto& sourceManager = ci.getSourceManager();
+    std::vector<std::string> headerFiles;
+    for (auto it = sourceManager.fileinfo_begin(), end = sourceManager.fileinfo_end(); it != end; ++it) {
+        headerFiles.push_back(it->first->getName());
+    }
+    std::sort(headerFiles.begin(), headerFiles.end());
+    for (auto& headerFile : headerFiles) {
+        module->addHeaderFile(headerFile);
+    }
+
     importer.addImportedModule(module);
-    allImportedModules[module->getName()] = module;
+    compiler.addImportedModule(module);
     return true;
 }
@@ -7,10 +7,11 @@ template<typename T> class ArrayRef;
 
 namespace delta {
 
+class CompilerInstance;
 class SourceFile;
 
 /// Returns true if the header was found and successfully imported.
 bool importCHeader(SourceFile& importer, llvm::StringRef headerName,
-                   llvm::ArrayRef<std::string> importSearchPaths);
+                   llvm::ArrayRef<std::string> importSearchPaths, CompilerInstance& compiler);
 
 }
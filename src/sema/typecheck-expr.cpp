@@ -6,6 +6,7 @@
 #include <llvm/ADT/APSInt.h>
 #include <llvm/ADT/iterator_range.h>
 #include <llvm/ADT/Optional.h>
+#include <llvm/ADT/Statistic.h>
 #include <llvm/Support/ErrorHandling.h>
 #include "../ast/decl.h"
 #include "../ast/expr.h"
@@ -14,6 +15,11 @@
 #include "../ast/type.h"
 #include "../support/utility.h"
 
+#define DEBUG_TYPE "sema"
+
+STATISTIC(NumOverloadResolutions, "Number of overload resolutions");
+STATISTIC(NumOverloadCandidates, "Number of candidates examined by overload resolution");
+
 using namespace delta;
 
 Type TypeChecker::typecheckVarExpr(VarExpr& expr) const {
@@ -24,7 +30,10 @@ Type TypeChecker::typecheckVarExpr(VarExpr& expr) const {
         case DeclKind::VarDecl: return llvm::cast<VarDecl>(decl).getType();
         case DeclKind::ParamDecl: return llvm::cast<ParamDecl>(decl).getType();
         case DeclKind::FunctionDecl:
-        case DeclKind::MethodDecl: return llvm::cast<FunctionDecl>(decl).getFunctionType();
+        case DeclKind::MethodDecl:
+            // The function may be called through the reference, so its body is needed too.
+            typecheckBodyIfDeferred(llvm::cast<FunctionDecl>(decl));
+            return llvm::cast<FunctionDecl>(decl).getFunctionType();
         case DeclKind::GenericParamDecl: llvm_unreachable("cannot refer to generic parameters yet");
         case DeclKind::InitDecl: llvm_unreachable("cannot refer to initializers yet");
         case DeclKind::DeinitDecl: llvm_unreachable("cannot refer to deinitializers yet");
@@ -377,10 +386,12 @@ FunctionLikeDecl& TypeChecker::resolveOverload(CallExpr& expr, llvm::StringRef c
     bool isInitCall = false;
     bool atLeastOneFunction = false;
     auto decls = findDecls(callee, typecheckingGenericFunction);
+    ++NumOverloadResolutions;
 
     for (Decl* decl : decls) {
         switch (decl->getKind()) {
             case DeclKind::FunctionDecl: case DeclKind::MethodDecl: {
+                ++NumOverloadCandidates;
                 auto& functionDecl = llvm::cast<FunctionDecl>(*decl);
                 SAVE_STATE(currentGenericArgs);
 
@@ -413,6 +424,7 @@ FunctionLikeDecl& TypeChecker::resolveOverload(CallExpr& expr, llvm::StringRef c
                 auto initDecls = findDecls(mangledName);
 
                 for (Decl* decl : initDecls) {
+                    ++NumOverloadCandidates;
                     InitDecl& initDecl = llvm::cast<InitDecl>(*decl);
                     SAVE_STATE(currentGenericArgs);
                     setCurrentGenericArgs(initDecl.getTypeDecl()->getGenericParams(), expr, initDecl.getParams());
@@ -517,6 +529,8 @@ Type TypeChecker::typecheckCallExpr(CallExpr& expr) const {
 
     expr.setCalleeDecl(decl);
 
+    typecheckBodyIfDeferred(*decl);
+
     if (auto* functionDecl = llvm::dyn_cast<FunctionDecl>(decl)) {
         auto* receiverTypeDecl = functionDecl->getTypeDecl();
         bool hasGenericReceiverType = receiverTypeDecl && receiverTypeDecl->isGeneric();
@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <iterator>
 #include <memory>
 #include <string>
@@ -6,45 +7,36 @@
 #include <cstdlib>
 #include <system_error>
 #include <llvm/ADT/ArrayRef.h>
+#include <llvm/ADT/SmallString.h>
 #include <llvm/ADT/StringRef.h>
 #include <llvm/ADT/SmallVector.h>
+#include <llvm/ADT/Statistic.h>
 #include <llvm/ADT/STLExtras.h>
+#include <llvm/Support/MD5.h>
 #include <llvm/Support/ErrorHandling.h>
-#include <llvm/Support/FileSystem.h>
 #include <llvm/Support/Path.h>
 #include <llvm/Support/ErrorOr.h>
+#include <clang/Basic/VirtualFileSystem.h>
 #include "typecheck.h"
 #include "c-import.h"
+#include "../ast/compiler-instance.h"
 #include "../ast/type.h"
 #include "../ast/expr.h"
 #include "../ast/decl.h"
 #include "../ast/module.h"
 #include "../ast/mangle.h"
 #include "../package-manager/manifest.h"
+#include "../support/hash.h"
+#include "../support/timing.h"
 #include "../support/utility.h"
 
-using namespace delta;
-
-namespace delta {
-std::unordered_map<std::string, std::shared_ptr<Module>> allImportedModules;
-}
-
-std::vector<Module*> delta::getAllImportedModules() {
-    return map(allImportedModules,
-               [](const std::pair<std::string, std::shared_ptr<Module>>& p) { return p.second.get(); });
-}
-
-namespace {
+#define DEBUG_TYPE "sema"
 
-/// Storage for Decls that are not in the AST but are referenced by the symbol table.
-std::vector<std::unique_ptr<Decl>> nonASTDecls;
+STATISTIC(NumGenericInstantiationsTypechecked, "Number of generic function instantiations type-checked");
+STATISTIC(NumFunctionBodiesDeferred, "Number of imported function bodies deferred until referenced");
+STATISTIC(NumFunctionBodiesTypecheckedOnDemand, "Number of deferred function bodies type-checked when referenced");
 
-llvm::MutableArrayRef<FieldDecl> currentFieldDecls;
-Type functionReturnType = nullptr;
-bool inInitializer = false;
-int breakableBlocks = 0;
-
-}
+using namespace delta;
 
 void TypeChecker::typecheckReturnStmt(ReturnStmt& stmt) const {
     if (stmt.getValues().empty()) {
@@ -269,8 +261,8 @@ void TypeChecker::addToSymbolTable(VarDecl& decl) const {
 template<typename DeclT>
 void TypeChecker::addToSymbolTableNonAST(DeclT& decl) const {
     std::string name = decl.getName();
-    nonASTDecls.push_back(llvm::make_unique<DeclT>(std::move(decl)));
-    getCurrentModule()->getSymbolTable().add(std::move(name), nonASTDecls.back().get());
+    auto& nonASTDecl = compiler->addNonASTDecl(llvm::make_unique<DeclT>(std::move(decl)));
+    getCurrentModule()->getSymbolTable().add(std::move(name), &nonASTDecl);
 }
 
 void TypeChecker::addToSymbolTable(FunctionDecl&& decl) const {
@@ -313,10 +305,10 @@ static Decl* findDeclInModules(llvm::StringRef name, SourceLocation location, co
     }
 }
 
-llvm::ArrayRef<std::shared_ptr<Module>> getStdlibModules() {
-    auto it = allImportedModules.find("std");
-    if (it == allImportedModules.end()) return {};
-    return it->second;
+llvm::SmallVector<Module*, 1> TypeChecker::getStdlibModules() const {
+    llvm::SmallVector<Module*, 1> modules;
+    if (auto stdlibModule = compiler->getImportedModule("std")) modules.push_back(stdlibModule.get());
+    return modules;
 }
 
 Decl& TypeChecker::findDecl(llvm::StringRef name, SourceLocation location, bool everywhere) const {
@@ -337,7 +329,7 @@ Decl& TypeChecker::findDecl(llvm::StringRef name, SourceLocation location, bool
     }
 
     if (everywhere) {
-        if (Decl* match = findDeclInModules(name, location, getAllImportedModules())) {
+        if (Decl* match = findDeclInModules(name, location, compiler->getImportedModules())) {
             return *match;
         }
     } else {
@@ -366,7 +358,7 @@ llvm::SmallVector<Decl*, 1> TypeChecker::findDecls(llvm::StringRef name, bool ev
         append(decls, findDeclsInModules(name, llvm::makeArrayRef(getCurrentModule())));
     }
     append(decls, findDeclsInModules(name, getStdlibModules()));
-    append(decls, everywhere ? findDeclsInModules(name, getAllImportedModules())
+    append(decls, everywhere ? findDeclsInModules(name, compiler->getImportedModules())
                              : findDeclsInModules(name, getCurrentSourceFile()->getImportedModules()));
     return decls;
 }
@@ -410,8 +402,29 @@ std::vector<Type> TypeChecker::getUnresolvedGenericArgs() const {
     });
 }
 
+bool TypeChecker::deferBodyTypechecking(FunctionLikeDecl& decl) const {
+    // Deinitializers and the string literal initializer are called implicitly by IRGen, so they're
+    // type-checked up front.
+    if (!typecheckBodiesOnDemand || decl.isDeinitDecl() || decl.hasGenericBody() || !decl.getBody()) {
+        return false;
+    }
+    if (auto* initDecl = llvm::dyn_cast<InitDecl>(&decl)) {
+        if (initDecl->isStringLiteralInitializer()) return false;
+    }
+    decl.setUncheckedBody(true);
+    ++NumFunctionBodiesDeferred;
+    return true;
+}
+
+void TypeChecker::typecheckBodyIfDeferred(FunctionLikeDecl& decl) const {
+    if (!decl.hasUncheckedBody()) return;
+    decl.setUncheckedBody(false);
+    functionBodiesToTypecheck.push_back(&decl);
+}
+
 void TypeChecker::typecheckFunctionLikeDecl(FunctionLikeDecl& decl) const {
     if (decl.isExtern()) return;
+    if (deferBodyTypechecking(decl)) return;
 
     if (decl.isGeneric() && currentGenericArgs.empty()) {
         typecheckGenericParamDecls(decl.getGenericParams());
@@ -452,12 +465,23 @@ void TypeChecker::typecheckFunctionLikeDecl(FunctionLikeDecl& decl) const {
 
     getCurrentModule()->getSymbolTable().popScope();
 
-    if (!decl.getReturnType().isVoid() && !allPathsReturn(*decl.getBody())) {
+    if (!decl.getReturnType().isVoid() && decl.getBody() && !allPathsReturn(*decl.getBody())) {
         error(decl.getLocation(), "'", decl.getName(), "' is missing a return statement");
     }
 }
 
+void TypeChecker::typecheckFunctionBody(FunctionLikeDecl& decl) {
+    if (auto* initDecl = llvm::dyn_cast<InitDecl>(&decl)) {
+        typecheckInitDecl(*initDecl);
+    } else {
+        typecheckFunctionLikeDecl(decl);
+    }
+    postProcess();
+}
+
 void TypeChecker::typecheckInitDecl(InitDecl& decl) const {
+    if (deferBodyTypechecking(decl)) return;
+
     getCurrentModule()->getSymbolTable().pushScope();
     SAVE_STATE(currentFunction);
     currentFunction = &decl;
@@ -474,8 +498,10 @@ void TypeChecker::typecheckInitDecl(InitDecl& decl) const {
     inInitializer = true;
     SAVE_STATE(currentFieldDecls);
     currentFieldDecls = decl.getTypeDecl()->getFields();
-    for (auto& stmt : *decl.getBody()) {
-        typecheckStmt(*stmt);
+    if (decl.getBody()) {
+        for (auto& stmt : *decl.getBody()) {
+            typecheckStmt(*stmt);
+        }
     }
 
     getCurrentModule()->getSymbolTable().popScope();
@@ -534,34 +560,124 @@ void TypeChecker::typecheckVarDecl(VarDecl& decl, bool isGlobal) const {
 
 void typecheckFieldDecl(FieldDecl&) {}
 
-std::error_code parseSourcesInDirectoryRecursively(llvm::StringRef directoryPath, Module& module,
-                                                   ParserFunction& parse) {
+std::error_code findSourceFilesRecursively(llvm::StringRef directoryPath, std::vector<std::string>& filePaths,
+                                           CompilerInstance& compiler) {
     std::error_code error;
-    llvm::sys::fs::recursive_directory_iterator it(directoryPath, error), end;
+    clang::vfs::recursive_directory_iterator it(compiler.getFileSystem(), directoryPath, error), end;
 
     for (; it != end; it.increment(error)) {
         if (error) break;
-
-        if (llvm::sys::path::extension(it->path()) == ".delta") {
-            parse(it->path(), module);
+        if (llvm::sys::path::extension(it->getName()) == ".delta") {
+            filePaths.push_back(it->getName());
         }
     }
 
     return error;
 }
 
+/// Returns a hash of the compiler binary and the relative paths and contents of the given source files of the
+/// module in `directoryPath`.
+std::string hashModuleSources(llvm::ArrayRef<std::string> sourceFilePaths, llvm::StringRef directoryPath,
+                              CompilerInstance& compiler) {
+    std::vector<std::string> sortedFilePaths(sourceFilePaths.begin(), sourceFilePaths.end());
+    std::sort(sortedFilePaths.begin(), sortedFilePaths.end());
+
+    // The relative paths are hashed instead of the full paths, so that the hash doesn't depend on how the path
+    // of the module directory is spelled.
+    llvm::MD5 hash;
+    hash.update(getCompilerIdentifier());
+    for (auto& filePath : sortedFilePaths) {
+        auto buffer = compiler.getFileSystem().getBufferForFile(filePath);
+        if (!buffer) printErrorAndExit("couldn't read '", filePath, "'");
+        hash.update(getModuleRelativePath(filePath, directoryPath));
+        hash.update(hashString((*buffer)->getBuffer()));
+    }
+    return toHexString(hash);
+}
+
+/// If one of the module interface directories of `compiler` contains an interface of `module` that was
+/// written from the given source files, and the library named by its stamp exists, parses the interface
+/// into `module` and returns true.
+bool parseModuleInterface(Module& module, llvm::ArrayRef<std::string> sourceFilePaths, ParserFunction& parse,
+                          CompilerInstance& compiler) {
+    auto& fileSystem = compiler.getFileSystem();
+    std::string sourceHash;
+
+    for (auto& interfaceDirectory : compiler.getModuleInterfaceDirectories()) {
+        llvm::SmallString<128> directoryPath(interfaceDirectory);
+        llvm::sys::path::append(directoryPath, module.getName());
+        llvm::SmallString<128> stampPath(directoryPath);
+        llvm::sys::path::append(stampPath, moduleInterfaceStampFileName);
+
+        auto stamp = fileSystem.getBufferForFile(stampPath);
+        if (!stamp) continue;
+        llvm::StringRef stampContents = (*stamp)->getBuffer();
+        auto hash = readLine(stampContents);
+        auto libraryName = readLine(stampContents);
+
+        if (sourceHash.empty()) {
+            sourceHash = hashModuleSources(sourceFilePaths, module.getSourceDirectory(), compiler);
+        }
+        if (hash != sourceHash || libraryName.empty()) continue;
+        llvm::SmallString<128> libraryPath;
+        if (llvm::sys::path::is_relative(libraryName)) libraryPath = directoryPath;
+        llvm::sys::path::append(libraryPath, libraryName);
+        if (!fileSystem.status(libraryPath)) continue;
+
+        std::vector<std::string> interfaceFilePaths;
+        std::error_code error;
+        for (clang::vfs::recursive_directory_iterator it(fileSystem, directoryPath, error), end; it != end;
+             it.increment(error)) {
+            if (error) break;
+            if (llvm::sys::path::extension(it->getName()) == ".deltai") {
+                interfaceFilePaths.push_back(it->getName());
+            }
+        }
+        if (error) continue;
+
+        std::sort(interfaceFilePaths.begin(), interfaceFilePaths.end());
+        for (auto& interfaceFilePath : interfaceFilePaths) {
+            parse(interfaceFilePath, module, compiler);
+        }
+        module.setLibraryPath(libraryPath);
+        return true;
+    }
+
+    return false;
+}
+
+/// Parses the module in the given directory into `module`, from its module interface if there's an
+/// up-to-date one, and otherwise from its source files.
+std::error_code parseModule(llvm::StringRef directoryPath, Module& module, ParserFunction& parse,
+                            CompilerInstance& compiler) {
+    std::vector<std::string> sourceFilePaths;
+    if (auto error = findSourceFilesRecursively(directoryPath, sourceFilePaths, compiler)) {
+        return error;
+    }
+    module.setSourceDirectory(directoryPath);
+
+    if (sourceFilePaths.empty() || parseModuleInterface(module, sourceFilePaths, parse, compiler)) {
+        return std::error_code();
+    }
+
+    for (auto& sourceFilePath : sourceFilePaths) {
+        parse(sourceFilePath, module, compiler);
+    }
+    return std::error_code();
+}
+
 llvm::ErrorOr<const Module&> importDeltaModule(SourceFile* importer,
                                                const PackageManifest* manifest,
                                                llvm::ArrayRef<std::string> importSearchPaths,
                                                ParserFunction& parse,
+                                               CompilerInstance& compiler,
                                                llvm::StringRef moduleExternalName,
                                                llvm::StringRef moduleInternalName = "") {
     if (moduleInternalName.empty()) moduleInternalName = moduleExternalName;
 
-    auto it = allImportedModules.find(moduleInternalName);
-    if (it != allImportedModules.end()) {
-        if (importer) importer->addImportedModule(it->second);
-        return *it->second;
+    if (auto importedModule = compiler.getImportedModule(moduleInternalName)) {
+        if (importer) importer->addImportedModule(importedModule);
+        return *importedModule;
     }
 
     auto module = std::make_shared<Module>(moduleInternalName);
@@ -570,20 +686,20 @@ llvm::ErrorOr<const Module&> importDeltaModule(SourceFile* importer,
     if (manifest) {
         for (auto& dependency : manifest->getDeclaredDependencies()) {
             if (dependency.getPackageIdentifier() == moduleInternalName) {
-                error = parseSourcesInDirectoryRecursively(dependency.getFileSystemPath(), *module, parse);
+                error = parseModule(dependency.getFileSystemPath(), *module, parse, compiler);
                 goto done;
             }
         }
     }
 
     for (llvm::StringRef importPath : importSearchPaths) {
-        llvm::sys::fs::directory_iterator it(importPath, error), end;
+        clang::vfs::directory_iterator it = compiler.getFileSystem().dir_begin(importPath, error), end;
         for (; it != end; it.increment(error)) {
             if (error) goto done;
-            if (!llvm::sys::fs::is_directory(it->path())) continue;
-            if (llvm::sys::path::filename(it->path()) != moduleExternalName) continue;
+            if (!it->isDirectory()) continue;
+            if (llvm::sys::path::filename(it->getName()) != moduleExternalName) continue;
 
-            error = parseSourcesInDirectoryRecursively(it->path(), *module, parse);
+            error = parseModule(it->getName(), *module, parse, compiler);
             goto done;
         }
     }
@@ -594,20 +710,20 @@ done:
     }
 
     if (importer) importer->addImportedModule(module);
-    allImportedModules[module->getName()] = module;
+    compiler.addImportedModule(module);
     typecheckModule(*module, /* TODO: Pass the package manifest of `module` here. */ nullptr,
-                    importSearchPaths, parse);
+                    importSearchPaths, parse, compiler, compiler.typechecksImportedBodiesOnDemand());
     return *module;
 }
 
 void TypeChecker::typecheckImportDecl(ImportDecl& decl, const PackageManifest* manifest,
                                       llvm::ArrayRef<std::string> importSearchPaths,
                                       ParserFunction& parse) const {
-    if (importDeltaModule(currentSourceFile, manifest, importSearchPaths, parse, decl.getTarget())) {
+    if (importDeltaModule(currentSourceFile, manifest, importSearchPaths, parse, *compiler, decl.getTarget())) {
         return;
     }
 
-    if (!importCHeader(*currentSourceFile, decl.getTarget(), importSearchPaths)) {
+    if (!importCHeader(*currentSourceFile, decl.getTarget(), importSearchPaths, *compiler)) {
         llvm::errs() << "error: couldn't find module or C header '" << decl.getTarget() << "'\n";
         abort();
     }
@@ -641,7 +757,54 @@ void TypeChecker::typecheckMemberDecl(Decl& decl) const {
     }
 }
 
+/// Returns the source file of `module` that contains `decl`.
+SourceFile& findSourceFile(Module& module, const Decl& decl) {
+    for (auto& sourceFile : module.getSourceFiles()) {
+        if (sourceFile.getFilePath() == decl.getLocation().file) return sourceFile;
+    }
+    llvm_unreachable("declaration not in any source file of its module");
+}
+
 void TypeChecker::postProcess() {
+    // The bodies and the instantiations can each reference more of the other.
+    while (!functionBodiesToTypecheck.empty() || !genericFunctionInstantiationsToTypecheck.empty()) {
+        typecheckReferencedFunctionBodies();
+        typecheckGenericFunctionInstantiations();
+    }
+}
+
+void TypeChecker::typecheckReferencedFunctionBodies() {
+    if (functionBodiesToTypecheck.empty()) return;
+    TimeScope timeScope("Type-check referenced functions",
+                        currentSourceFile ? currentSourceFile->getFilePath() : currentModule->getName());
+
+    while (!functionBodiesToTypecheck.empty()) {
+        FunctionLikeDecl& decl = *functionBodiesToTypecheck.back();
+        functionBodiesToTypecheck.pop_back();
+
+        // Each body is type-checked in the context of its own module and source file.
+        Module& module = *decl.getModule();
+        TypeChecker typeChecker(&module, &findSourceFile(module, decl), *compiler);
+        if (auto* initDecl = llvm::dyn_cast<InitDecl>(&decl)) {
+            typeChecker.typecheckInitDecl(*initDecl);
+        } else {
+            typeChecker.typecheckFunctionLikeDecl(decl);
+        }
+        ++NumFunctionBodiesTypecheckedOnDemand;
+
+        // Continue with the functions called by the body here instead of recursing into them.
+        functionBodiesToTypecheck.insert(functionBodiesToTypecheck.end(),
+                                         typeChecker.functionBodiesToTypecheck.begin(),
+                                         typeChecker.functionBodiesToTypecheck.end());
+        typeChecker.functionBodiesToTypecheck.clear();
+        typeChecker.postProcess();
+    }
+}
+
+void TypeChecker::typecheckGenericFunctionInstantiations() {
+    if (genericFunctionInstantiationsToTypecheck.empty()) return;
+    TimeScope timeScope("Type-check generic instantiations",
+                        currentSourceFile ? currentSourceFile->getFilePath() : currentModule->getName());
     SAVE_STATE(typecheckingGenericFunction);
     typecheckingGenericFunction = true;
 
@@ -652,22 +815,38 @@ void TypeChecker::postProcess() {
                                                     functionDeclAndCallExpr.second);
             // TODO: Don't typecheck more than once with the same generic arguments.
             typecheckFunctionLikeDecl(functionDeclAndCallExpr.first);
+            ++NumGenericInstantiationsTypechecked;
             currentGenericArgs.clear();
         }
     }
 }
 
+const char delta::moduleInterfaceStampFileName[] = "module.stamp";
+
+std::string delta::hashModuleDirectory(llvm::StringRef directoryPath, CompilerInstance& compiler) {
+    std::vector<std::string> sourceFilePaths;
+    if (findSourceFilesRecursively(directoryPath, sourceFilePaths, compiler)) return "";
+    return hashModuleSources(sourceFilePaths, directoryPath, compiler);
+}
+
+llvm::StringRef delta::getModuleRelativePath(llvm::StringRef filePath, llvm::StringRef directoryPath) {
+    // The source file paths are found by iterating the module directory, so they start with its path.
+    ASSERT(filePath.startswith(directoryPath));
+    return filePath.drop_front(directoryPath.size()).ltrim(llvm::sys::path::get_separator());
+}
+
 void delta::typecheckModule(Module& module, const PackageManifest* manifest,
                             llvm::ArrayRef<std::string> importSearchPaths,
-                            ParserFunction& parse) {
-    auto stdlibModule = importDeltaModule(nullptr, nullptr, importSearchPaths, parse, "stdlib", "std");
+                            ParserFunction& parse, CompilerInstance& compiler, bool typecheckBodiesOnDemand) {
+    TimeScope timeScope("Type-check", module.getName());
+    auto stdlibModule = importDeltaModule(nullptr, nullptr, importSearchPaths, parse, compiler, "stdlib", "std");
     if (!stdlibModule) {
         printErrorAndExit("couldn't import the standard library: ", stdlibModule.getError().message());
     }
 
     // Infer the types of global variables for use before their declaration.
     for (auto& sourceFile : module.getSourceFiles()) {
-        TypeChecker typeChecker(&module, &sourceFile);
+        TypeChecker typeChecker(&module, &sourceFile, compiler);
 
         for (auto& decl : sourceFile.getTopLevelDecls()) {
             if (auto* varDecl = llvm::dyn_cast<VarDecl>(decl.get())) {
@@ -679,7 +858,8 @@ void delta::typecheckModule(Module& module, const PackageManifest* manifest,
     }
 
     for (auto& sourceFile : module.getSourceFiles()) {
-        TypeChecker typeChecker(&module, &sourceFile);
+        TypeChecker typeChecker(&module, &sourceFile, compiler);
+        typeChecker.setTypecheckBodiesOnDemand(typecheckBodiesOnDemand);
 
         for (auto& decl : sourceFile.getTopLevelDecls()) {
             if (!decl->isVarDecl()) {
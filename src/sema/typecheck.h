@@ -17,26 +17,44 @@ template<typename T, unsigned N> class SmallVector;
 
 namespace delta {
 
+class CompilerInstance;
 class Module;
 class PackageManifest;
 class SourceFile;
 struct SourceLocation;
 struct Type;
 
-using ParserFunction = void(llvm::StringRef filePath, Module& module);
+using ParserFunction = void(llvm::StringRef filePath, Module& module, CompilerInstance& compiler);
 
-std::vector<Module*> getAllImportedModules();
+/// If `typecheckBodiesOnDemand` is true, the bodies of the non-generic functions of `module` are type-checked
+/// only once a type-checked body calls them, like generic functions are type-checked when instantiated.
+/// This is used for imported modules, of which programs typically call only a small part.
 void typecheckModule(Module& module, const PackageManifest* manifest,
-                     llvm::ArrayRef<std::string> importSearchPaths, ParserFunction& parse);
+                     llvm::ArrayRef<std::string> importSearchPaths, ParserFunction& parse,
+                     CompilerInstance& compiler, bool typecheckBodiesOnDemand = false);
+
+/// The name of the file in a module interface directory that identifies the module sources the interface
+/// was written from, by their hashModuleDirectory() hash on its first line, and names the library containing
+/// the non-generic code of the module on its second line, relative to the directory unless it's absolute.
+extern const char moduleInterfaceStampFileName[];
+/// Returns a hash of the compiler binary and the relative paths and contents of the source files of the module in
+/// `directoryPath`, or an empty string if the directory can't be read.
+std::string hashModuleDirectory(llvm::StringRef directoryPath, CompilerInstance& compiler);
+/// Returns the path of the source file `filePath` relative to the directory of its module, `directoryPath`.
+/// Module interfaces mirror the subdirectories of the module, so that source files with the same name in
+/// different subdirectories get different interface files.
+llvm::StringRef getModuleRelativePath(llvm::StringRef filePath, llvm::StringRef directoryPath);
 
 class TypeChecker : public TypeResolver {
 public:
-    explicit TypeChecker(Module* currentModule, SourceFile* currentSourceFile)
-    : currentModule(currentModule), currentSourceFile(currentSourceFile), currentFunction(nullptr),
-      typecheckingGenericFunction(false) {}
+    explicit TypeChecker(Module* currentModule, SourceFile* currentSourceFile, CompilerInstance& compiler)
+    : currentModule(currentModule), currentSourceFile(currentSourceFile), compiler(&compiler),
+      currentFunction(nullptr), currentFieldDecls(), functionReturnType(nullptr), inInitializer(false),
+      breakableBlocks(0), typecheckingGenericFunction(false), typecheckBodiesOnDemand(false) {}
 
     Module* getCurrentModule() const { return currentModule; }
     const SourceFile* getCurrentSourceFile() const { return currentSourceFile; }
+    CompilerInstance& getCompilerInstance() const { return *compiler; }
 
     Decl& findDecl(llvm::StringRef name, SourceLocation location, bool everywhere = false) const;
     llvm::SmallVector<Decl*, 1> findDecls(llvm::StringRef name, bool everywhere = false) const;
@@ -57,11 +75,22 @@ public:
                                llvm::ArrayRef<std::string> importSearchPaths,
                                ParserFunction& parse) const;
     void postProcess();
+    /// Makes the type-checker skip the non-generic function bodies it encounters, and type-check them only
+    /// when a call to them is resolved. See typecheckModule().
+    void setTypecheckBodiesOnDemand(bool onDemand) { typecheckBodiesOnDemand = onDemand; }
+    /// Type-checks a function whose body has been parsed by parseDeferredFunctionBody() after the rest of
+    /// the module was type-checked, followed by the generic functions instantiated by the body.
+    void typecheckFunctionBody(FunctionLikeDecl& decl);
 
 private:
     void typecheckFunctionLikeDecl(FunctionLikeDecl& decl) const;
     void typecheckInitDecl(InitDecl& decl) const;
     void typecheckMemberDecl(Decl& decl) const;
+    bool deferBodyTypechecking(FunctionLikeDecl& decl) const;
+    /// Queues the body of `decl` for type-checking if it was deferred until the function is referenced.
+    void typecheckBodyIfDeferred(FunctionLikeDecl& decl) const;
+    void typecheckReferencedFunctionBodies();
+    void typecheckGenericFunctionInstantiations();
 
     void typecheckStmt(Stmt& stmt) const;
     void typecheckAssignStmt(AssignStmt& stmt) const;
@@ -115,14 +144,23 @@ private:
     void addToSymbolTableCheckParams(DeclT& decl) const;
     template<typename DeclT>
     void addToSymbolTableNonAST(DeclT& decl) const;
+    llvm::SmallVector<Module*, 1> getStdlibModules() const;
 
 private:
     Module* currentModule;
     SourceFile* currentSourceFile;
+    CompilerInstance* compiler;
     mutable FunctionLikeDecl* currentFunction;
+    mutable llvm::MutableArrayRef<FieldDecl> currentFieldDecls;
+    mutable Type functionReturnType;
+    mutable bool inInitializer;
+    mutable int breakableBlocks;
     mutable std::unordered_map<std::string, Type> currentGenericArgs;
     mutable bool typecheckingGenericFunction;
     mutable std::vector<std::pair<FunctionDecl&, CallExpr&>> genericFunctionInstantiationsToTypecheck;
+    bool typecheckBodiesOnDemand;
+    /// The functions with unchecked bodies that have been called by type-checked code.
+    mutable std::vector<FunctionLikeDecl*> functionBodiesToTypecheck;
 };
 
 }
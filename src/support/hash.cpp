@@ -0,0 +1,37 @@
+#include <llvm/ADT/SmallString.h>
+#include <llvm/ADT/StringRef.h>
+#include <llvm/Support/Chrono.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/MD5.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include "hash.h"
+
+using namespace delta;
+
+std::string delta::toHexString(llvm::MD5& hash) {
+    llvm::MD5::MD5Result result;
+    hash.final(result);
+    llvm::SmallString<32> string;
+    llvm::MD5::stringifyResult(result, string);
+    return string.str();
+}
+
+std::string delta::hashString(llvm::StringRef data) {
+    llvm::MD5 hash;
+    hash.update(data);
+    return toHexString(hash);
+}
+
+std::string delta::hashFile(llvm::StringRef filePath) {
+    auto buffer = llvm::MemoryBuffer::getFile(filePath);
+    if (!buffer) return "";
+    return hashString((*buffer)->getBuffer());
+}
+
+std::string delta::getCompilerIdentifier() {
+    auto path = llvm::sys::fs::getMainExecutable(nullptr, reinterpret_cast<void*>(&getCompilerIdentifier));
+    llvm::sys::fs::file_status status;
+    if (llvm::sys::fs::status(path, status)) return path;
+    return path + ":" + std::to_string(status.getSize()) + ":" +
+           std::to_string(llvm::sys::toTimeT(status.getLastModificationTime()));
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <string>
+
+namespace llvm {
+class MD5;
+class StringRef;
+}
+
+namespace delta {
+
+/// Finalizes `hash` and returns it as a hexadecimal string.
+std::string toHexString(llvm::MD5& hash);
+/// Returns the MD5 hash of `data` as a hexadecimal string.
+std::string hashString(llvm::StringRef data);
+/// Returns the MD5 hash of the given file's contents, or an empty string if the file can't be read.
+std::string hashFile(llvm::StringRef filePath);
+/// Returns a string that identifies the running compiler binary, for invalidating cached build outputs
+/// when the compiler changes.
+std::string getCompilerIdentifier();
+
+}
@@ -0,0 +1,126 @@
+#include "memory-stats.h"
+#include <mutex>
+#include <string>
+#include <vector>
+#include <sys/resource.h>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+#include <llvm/ADT/MapVector.h>
+#include <llvm/ADT/StringRef.h>
+#include <llvm/Support/Format.h>
+#include <llvm/Support/Process.h>
+#include <llvm/Support/raw_ostream.h>
+#include "utility.h"
+
+using namespace delta;
+
+namespace {
+
+struct PhaseMemoryUsage {
+    std::string phase;
+    uint64_t heapUsage;
+    uint64_t peakResidentSetSize;
+};
+
+bool memoryStatsEnabled = false;
+uint64_t memoryBudget = 0;
+bool memoryBudgetExceeded = false;
+std::mutex memoryStatsMutex;
+llvm::MapVector<std::string, llvm::MapVector<std::string, int64_t>> memoryUsageByCategory;
+std::vector<PhaseMemoryUsage> phaseMemoryUsages;
+
+llvm::raw_ostream& printMegabytes(llvm::raw_ostream& stream, int64_t bytes) {
+    return stream << llvm::format("%10.2f", bytes / (1024.0 * 1024.0));
+}
+
+} // anonymous namespace
+
+uint64_t delta::getHeapUsage() {
+    // Large allocations, such as the buffers of big source files and IR modules, are mmapped by glibc and
+    // counted separately from the other chunks in use.
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+    auto info = ::mallinfo2();
+    return uint64_t(info.uordblks) + uint64_t(info.hblkhd);
+#elif defined(__GLIBC__)
+    // The fields of the older mallinfo are ints, so each of them wraps around past 4 GB even when read as
+    // unsigned.
+    auto info = ::mallinfo();
+    return uint64_t(unsigned(info.uordblks)) + uint64_t(unsigned(info.hblkhd));
+#else
+    return llvm::sys::Process::GetMallocUsage();
+#endif
+}
+
+uint64_t delta::getPeakResidentSetSize() {
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+#ifdef __APPLE__
+    return usage.ru_maxrss; // In bytes.
+#else
+    return uint64_t(usage.ru_maxrss) * 1024; // In kilobytes.
+#endif
+}
+
+void delta::enableMemoryStats(uint64_t budget) {
+    memoryStatsEnabled = true;
+    memoryBudget = budget;
+}
+
+bool delta::isMemoryStatsEnabled() {
+    return memoryStatsEnabled;
+}
+
+void delta::recordMemoryUsage(llvm::StringRef category, llvm::StringRef item, int64_t bytes) {
+    if (!memoryStatsEnabled) return;
+    std::lock_guard<std::mutex> lock(memoryStatsMutex);
+    memoryUsageByCategory[category][item] += bytes;
+}
+
+void delta::recordPhaseMemoryUsage(llvm::StringRef phase) {
+    if (!memoryStatsEnabled) return;
+    auto peakResidentSetSize = getPeakResidentSetSize();
+
+    std::lock_guard<std::mutex> lock(memoryStatsMutex);
+    phaseMemoryUsages.push_back({ phase, getHeapUsage(), peakResidentSetSize });
+
+    if (memoryBudget != 0 && peakResidentSetSize > memoryBudget && !memoryBudgetExceeded) {
+        memoryBudgetExceeded = true;
+        warning(SourceLocation::invalid(), "peak memory usage of ", peakResidentSetSize / (1024 * 1024),
+                " MB after phase '", phase, "' exceeds the memory budget of ", memoryBudget / (1024 * 1024),
+                " MB");
+    }
+}
+
+void delta::printMemoryReport(llvm::raw_ostream& stream) {
+    std::lock_guard<std::mutex> lock(memoryStatsMutex);
+
+    stream << "===---------------------------------------------------------------===\n"
+           << "                    Delta compilation memory report\n"
+           << "===---------------------------------------------------------------===\n"
+           << "   Heap (MB)  Peak RSS (MB)  After phase\n";
+
+    for (auto& usage : phaseMemoryUsages) {
+        printMegabytes(stream, usage.heapUsage) << "     ";
+        printMegabytes(stream, usage.peakResidentSetSize) << "  " << usage.phase << "\n";
+    }
+
+    for (auto& categoryAndItems : memoryUsageByCategory) {
+        stream << "\n        (MB)  " << categoryAndItems.first << "\n";
+        for (auto& itemAndBytes : categoryAndItems.second) {
+            printMegabytes(stream, itemAndBytes.second) << "    " << itemAndBytes.first << "\n";
+        }
+    }
+}
+
+HeapUsageScope::HeapUsageScope(llvm::StringRef category, llvm::StringRef item) : heapUsageAtStart(-1) {
+    if (!memoryStatsEnabled) return;
+    this->category = category;
+    this->item = item;
+    heapUsageAtStart = getHeapUsage();
+}
+
+HeapUsageScope::~HeapUsageScope() {
+    if (heapUsageAtStart < 0) return;
+    recordMemoryUsage(category, item, int64_t(getHeapUsage()) - heapUsageAtStart);
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+namespace llvm {
+class raw_ostream;
+class StringRef;
+}
+
+namespace delta {
+
+/// Returns the number of bytes currently allocated on the heap, including mmapped allocations, or 0 if it
+/// can't be determined. With glibc versions before 2.33, the result is only accurate up to 4 GB.
+uint64_t getHeapUsage();
+/// Returns the highest resident set size of the process so far in bytes, or 0 if it can't be determined.
+uint64_t getPeakResidentSetSize();
+
+/// Starts recording the memory statistics printed by '-print-memory-stats'. If `budget` is non-zero,
+/// a warning is printed at the first phase boundary at which the peak RSS exceeds `budget` bytes.
+void enableMemoryStats(uint64_t budget);
+bool isMemoryStatsEnabled();
+/// Adds `bytes` to the size recorded for `item` in the given category of the memory report.
+void recordMemoryUsage(llvm::StringRef category, llvm::StringRef item, int64_t bytes);
+/// Records the heap usage and peak RSS at the end of the given compilation phase.
+void recordPhaseMemoryUsage(llvm::StringRef phase);
+void printMemoryReport(llvm::raw_ostream& stream);
+
+/// Records the heap growth from construction to destruction as the size of `item` in `category`, if
+/// memory statistics are enabled. Memory freed in between is subtracted, so this measures what's retained.
+class HeapUsageScope {
+public:
+    HeapUsageScope(llvm::StringRef category, llvm::StringRef item);
+    ~HeapUsageScope();
+    HeapUsageScope(const HeapUsageScope&) = delete;
+    HeapUsageScope& operator=(const HeapUsageScope&) = delete;
+
+private:
+    std::string category;
+    std::string item;
+    /// The heap usage at construction, or -1 if memory statistics are disabled.
+    int64_t heapUsageAtStart;
+};
+
+}
@@ -0,0 +1,212 @@
+#include "timing.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <llvm/ADT/MapVector.h>
+#include <llvm/ADT/StringRef.h>
+#include <llvm/Pass.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/Format.h>
+#include <llvm/Support/Timer.h>
+#include <llvm/Support/raw_ostream.h>
+#include "utility.h"
+
+using namespace delta;
+
+namespace {
+
+struct TimeRecord {
+    std::string phase;
+    std::string detail;
+    int64_t startTime;
+    int64_t duration;
+    unsigned threadIndex;
+};
+
+std::atomic<bool> timingEnabled(false);
+std::chrono::steady_clock::time_point timingStartTime;
+std::mutex timeRecordsMutex;
+std::vector<TimeRecord> timeRecords;
+std::unordered_map<std::thread::id, unsigned> threadIndices;
+bool passTimingsPrinted = false;
+
+int64_t getElapsedMicroseconds() {
+    auto elapsed = std::chrono::steady_clock::now() - timingStartTime;
+    return std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count();
+}
+
+void writeJSONString(llvm::raw_ostream& stream, llvm::StringRef string) {
+    stream << '"';
+    for (char ch : string) {
+        switch (ch) {
+            case '"': stream << "\\\""; break;
+            case '\\': stream << "\\\\"; break;
+            case '\n': stream << "\\n"; break;
+            case '\t': stream << "\\t"; break;
+            default:
+                if (static_cast<unsigned char>(ch) < 0x20) {
+                    stream << llvm::format("\\u%04x", static_cast<unsigned>(ch));
+                } else {
+                    stream << ch;
+                }
+        }
+    }
+    stream << '"';
+}
+
+} // anonymous namespace
+
+TimeScope::TimeScope(llvm::StringRef phase, llvm::StringRef detail) : startTime(-1) {
+    if (!timingEnabled.load(std::memory_order_acquire)) return;
+    this->phase = phase;
+    this->detail = detail;
+    startTime = getElapsedMicroseconds();
+}
+
+TimeScope::~TimeScope() {
+    if (startTime < 0) return;
+    int64_t duration = getElapsedMicroseconds() - startTime;
+
+    std::lock_guard<std::mutex> lock(timeRecordsMutex);
+    auto threadIndex = threadIndices.emplace(std::this_thread::get_id(), threadIndices.size()).first->second;
+    timeRecords.push_back({ std::move(phase), std::move(detail), startTime, duration, threadIndex });
+}
+
+void delta::enableTiming() {
+    if (timingEnabled) return;
+    timingStartTime = std::chrono::steady_clock::now();
+    llvm::TimePassesIsEnabled = true;
+    timingEnabled.store(true, std::memory_order_release);
+}
+
+void delta::printTimeReport(llvm::raw_ostream& stream) {
+    struct PhaseTotal {
+        int64_t duration = 0;
+        unsigned count = 0;
+        llvm::MapVector<llvm::StringRef, int64_t> detailDurations;
+    };
+
+    std::lock_guard<std::mutex> lock(timeRecordsMutex);
+    auto records = timeRecords;
+    std::stable_sort(records.begin(), records.end(), [](const TimeRecord& a, const TimeRecord& b) {
+        return a.startTime < b.startTime;
+    });
+
+    // Scopes nest, e.g. an imported module is parsed and type-checked within the type-checking of its
+    // importer, so each scope is attributed only its self time, i.e. its duration minus that of the scopes
+    // directly nested in it. Otherwise the nested time would be counted once for each enclosing scope.
+    std::vector<size_t> nestingOrder(records.size());
+    for (size_t i = 0; i < records.size(); ++i) nestingOrder[i] = i;
+    // Sort enclosing scopes before the scopes nested in them, like in writeTimeTrace().
+    std::sort(nestingOrder.begin(), nestingOrder.end(), [&](size_t aIndex, size_t bIndex) {
+        auto& a = records[aIndex];
+        auto& b = records[bIndex];
+        if (a.threadIndex != b.threadIndex) return a.threadIndex < b.threadIndex;
+        if (a.startTime != b.startTime) return a.startTime < b.startTime;
+        return a.duration > b.duration;
+    });
+
+    std::vector<int64_t> selfDurations(records.size());
+    std::vector<size_t> enclosingScopes;
+    int64_t totalDuration = 0;
+    for (size_t index : nestingOrder) {
+        auto& record = records[index];
+        while (!enclosingScopes.empty()) {
+            auto& enclosing = records[enclosingScopes.back()];
+            if (enclosing.threadIndex == record.threadIndex &&
+                enclosing.startTime + enclosing.duration > record.startTime) break;
+            enclosingScopes.pop_back();
+        }
+        if (enclosingScopes.empty()) {
+            totalDuration += record.duration;
+        } else {
+            selfDurations[enclosingScopes.back()] -= record.duration;
+        }
+        selfDurations[index] += record.duration;
+        enclosingScopes.push_back(index);
+    }
+
+    // Phases are listed in the order in which they first ran.
+    llvm::MapVector<llvm::StringRef, PhaseTotal> phaseTotals;
+    for (size_t i = 0; i < records.size(); ++i) {
+        auto& total = phaseTotals[records[i].phase];
+        int64_t selfDuration = std::max(selfDurations[i], int64_t(0));
+        total.duration += selfDuration;
+        total.count++;
+        total.detailDurations[records[i].detail] += selfDuration;
+    }
+
+    const size_t maxDetailsPerPhase = 10;
+    stream << "===---------------------------------------------------------------===\n"
+           << "                    Delta compilation time report\n"
+           << "===---------------------------------------------------------------===\n"
+           << "  Self time (s)   Count  Phase\n";
+
+    for (auto& phaseAndTotal : phaseTotals) {
+        auto& total = phaseAndTotal.second;
+        stream << llvm::format("  %13.4f  %6u  ", total.duration / 1e6, total.count);
+        stream << phaseAndTotal.first << "\n";
+
+        auto details = total.detailDurations.takeVector();
+        using DetailDuration = std::pair<llvm::StringRef, int64_t>;
+        std::stable_sort(details.begin(), details.end(), [](const DetailDuration& a, const DetailDuration& b) {
+            return a.second > b.second;
+        });
+
+        for (size_t i = 0; i < std::min(details.size(), maxDetailsPerPhase); ++i) {
+            if (details[i].first.empty()) continue;
+            stream << llvm::format("  %13.4f            ", details[i].second / 1e6) << details[i].first << "\n";
+        }
+        if (details.size() > maxDetailsPerPhase) {
+            stream << "                           (" << details.size() - maxDetailsPerPhase << " more)\n";
+        }
+    }
+
+    stream << llvm::format("  %13.4f          ", totalDuration / 1e6) << "Total\n\n";
+    llvm::TimerGroup::printAll(stream);
+    passTimingsPrinted = true;
+}
+
+void delta::writeTimeTrace(llvm::StringRef filePath) {
+    std::error_code error;
+    llvm::raw_fd_ostream file(filePath, error, llvm::sys::fs::F_Text);
+    if (error) printErrorAndExit("couldn't write '", filePath, "': ", error.message());
+
+    std::lock_guard<std::mutex> lock(timeRecordsMutex);
+    auto records = timeRecords;
+    // Sort enclosing spans before the spans nested in them.
+    std::sort(records.begin(), records.end(), [](const TimeRecord& a, const TimeRecord& b) {
+        if (a.threadIndex != b.threadIndex) return a.threadIndex < b.threadIndex;
+        if (a.startTime != b.startTime) return a.startTime < b.startTime;
+        return a.duration > b.duration;
+    });
+
+    file << "{\"traceEvents\":[";
+    const char* separator = "\n";
+
+    for (auto& record : records) {
+        file << separator << "{\"name\":";
+        writeJSONString(file, record.phase);
+        file << ",\"cat\":\"delta\",\"ph\":\"X\",\"pid\":1,\"tid\":" << record.threadIndex
+             << ",\"ts\":" << record.startTime << ",\"dur\":" << record.duration << ",\"args\":{\"detail\":";
+        writeJSONString(file, record.detail);
+        file << "}}";
+        separator = ",\n";
+    }
+
+    file << "\n],\n\"displayTimeUnit\":\"ms\"";
+
+    // The LLVM pass timers only record totals, so they're included as a separate object rather than as
+    // spans. They're reset when printed, so they're missing here if the time report already printed them.
+    if (!passTimingsPrinted) {
+        file << ",\n\"llvmPassTimings\":{";
+        llvm::TimerGroup::printAllJSONValues(file, "\n");
+        file << "\n}";
+    }
+
+    file << "\n}\n";
+}
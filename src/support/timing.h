@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+namespace llvm {
+class raw_ostream;
+class StringRef;
+}
+
+namespace delta {
+
+/// Measures the time spent in a compiler phase from construction to destruction, if timing has been
+/// enabled with enableTiming(). `detail` identifies what the phase is working on, e.g. a file or module
+/// name. Scopes may be nested, and are then shown as nested spans in the time trace.
+class TimeScope {
+public:
+    TimeScope(llvm::StringRef phase, llvm::StringRef detail);
+    ~TimeScope();
+    TimeScope(const TimeScope&) = delete;
+    TimeScope& operator=(const TimeScope&) = delete;
+
+private:
+    std::string phase;
+    std::string detail;
+    /// In microseconds since timing was enabled, or -1 if timing is disabled.
+    int64_t startTime;
+};
+
+/// Starts recording the time spent in each TimeScope, and enables LLVM's per-pass timers.
+void enableTiming();
+/// Prints the total time spent in each phase, excluding the time spent in nested scopes, the slowest files
+/// or functions within each phase, and the LLVM pass timings. Used for '-ftime-report'.
+void printTimeReport(llvm::raw_ostream& stream);
+/// Writes the recorded scopes to `filePath` as a Chrome trace event JSON file, which can be viewed
+/// e.g. in chrome://tracing. Used for '-ftime-trace=<file>'.
+void writeTimeTrace(llvm::StringRef filePath);
+
+}
@@ -0,0 +1,5 @@
+int twice(int n);
+
+int callTwice(int n) {
+    return twice(n);
+}
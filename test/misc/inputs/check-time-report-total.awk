@@ -0,0 +1,11 @@
+# Checks that the phase times in a Delta compilation time report add up to its total, allowing for the
+# rounding of each line to four decimals.
+/^$/ { exit }
+NF >= 3 && $1 ~ /^[0-9.]+$/ && $2 ~ /^[0-9]+$/ { phases++; sum += $1 }
+NF == 2 && $2 == "Total" { total = $1 }
+END {
+    if (phases == 0 || sum > total + phases * 0.0001) {
+        printf "phase times add up to %f, but the total is %f\n", sum, total
+        exit 1
+    }
+}